@@ -51,6 +51,8 @@
 
 
 #include "laplacian.hpp"
+#include "meshadaptation.hpp"
+#include "reducedbasis.hpp"
 #if defined( FEELPP_HAS_PETSC4PY )
 #include <petsc4py/petsc4py.h>
 #endif
@@ -64,6 +66,7 @@
 #include <feel/feelcore/json.hpp>
 #include <feel/feelpython/pybind11/eigen.h>
 #include <feel/feelpython/pybind11/json.h>
+#include <feel/feelpython/pybind11/numpy.h>
 #include <feel/feelpython/pybind11/pybind11.h>
 #include <feel/feelpython/pybind11/stl.h>
 #include <feel/feelpython/pybind11/stl_bind.h>
@@ -72,56 +75,190 @@
 
 namespace py = pybind11;
 
+/**
+ * @brief numpy view of the local values of an element, including the ghosts
+ *
+ * @param u element with contiguous local storage
+ * @param base python object owning @p u, kept alive by the array
+ */
+template<typename ElementType>
+py::array_t<double>
+localArray( ElementType& u, py::handle base )
+{
+    std::size_t n = u.map().nLocalDofWithGhost();
+    if ( n == 0 )
+        return py::array_t<double>( 0 );
+    double* data = &u( 0 );
+    if ( &u( n - 1 ) != data + n - 1 )
+        throw std::runtime_error( "the local values of u are not contiguous" );
+    return py::array_t<double>( { n }, { sizeof( double ) }, data, base );
+}
+
+/**
+ * @brief numpy copy of a column of measures
+ *
+ * the column is cleared by a new run, solveBatch() and the flushes of the
+ * store, and reallocated when it grows, a view would not outlive them
+ */
+inline py::array_t<double>
+columnArray( std::vector<double> const& c )
+{
+    return py::array_t<double>( c.size(), c.data() );
+}
+
+/**
+ * @brief call guard of the methods working in PETSc and MPI
+ *
+ * the GIL is released first so that the other Python threads run while the
+ * method waits for the lock and then works
+ */
+using release_gil = py::call_guard<py::gil_scoped_release, Feel::SolveLock>;
+
+//! deleter destroying the PETSc objects of an instance under the same lock, without the GIL
+template<typename T>
+struct LockedDelete
+{
+    void operator()( T* p ) const
+    {
+        py::gil_scoped_release release;
+        Feel::SolveLock lock;
+        delete p;
+    }
+};
+
 template<int Dim,int Order>
 void
 laplacian_inst( py::module &m )
 {
     using namespace Feel;
 
-    py::class_<Laplacian<Dim, Order>>( m, fmt::format( "Laplacian{}DP{}", Dim, Order ).c_str() )
+    py::class_<Laplacian<Dim, Order>, std::unique_ptr<Laplacian<Dim, Order>, LockedDelete<Laplacian<Dim, Order>>>>( m, fmt::format( "Laplacian{}DP{}", Dim, Order ).c_str() )
         .def( py::init<>() )
-        .def( py::init<const nl::json&>() )
-        .def( "initialize", &Laplacian<Dim, Order>::initialize, "Initialize the Laplacian instance" )
-        .def( "processMaterials", &Laplacian<Dim, Order>::processMaterials, "Process materials from the json data" )
-        .def( "processBoundaryConditions", &Laplacian<Dim, Order>::processBoundaryConditions, "Process boundary conditions from the json data" )
-        .def( "run", &Laplacian<Dim, Order>::run, "Run the Laplacian instance" )
-        .def( "timeLoop", &Laplacian<Dim, Order>::timeLoop, "Execute the time loop" )
+        .def( py::init<const nl::json&>(), release_gil() )
+        .def( "id", &Laplacian<Dim, Order>::id, "Return the number of the instance in the process, the exported files of the next instances are suffixed by it" )
+        .def( "initialize", &Laplacian<Dim, Order>::initialize, "Initialize the Laplacian instance", release_gil() )
+        .def( "processMaterials", &Laplacian<Dim, Order>::processMaterials, "Process materials from the json data", release_gil() )
+        .def( "processBoundaryConditions", &Laplacian<Dim, Order>::processBoundaryConditions, "Process boundary conditions from the json data", release_gil() )
+        .def( "run", &Laplacian<Dim, Order>::run, "Run the Laplacian instance, the GIL is released meanwhile", release_gil() )
+        .def( "timeLoop", &Laplacian<Dim, Order>::timeLoop, "Execute the time loop, or the single solve of the steady case", release_gil() )
+        .def( "isSteady", &Laplacian<Dim, Order>::isSteady, "True if the steady state is computed with one solve" )
         .def(
             "exportResults", []( Laplacian<Dim, Order> const& l )
             { l.exportResults(); },
-            "Postprocess and export the results" )
+            "Postprocess and export the results", release_gil() )
         .def(
             "exportResults", []( Laplacian<Dim, Order> const& l, typename Laplacian<Dim, Order>::element_t const& u )
             { l.exportResults( 0, u ); },
-            "Postprocess and export the results for steady case" )
+            "Postprocess and export the results for steady case", release_gil() )
         .def(
             "exportResults", []( Laplacian<Dim, Order> const& l, double t, typename Laplacian<Dim, Order>::element_t const& u )
             { l.exportResults( t, u ); },
-            "Postprocess and export the results at time t" )
-        .def( "summary", &Laplacian<Dim, Order>::summary )
+            "Postprocess and export the results at time t", release_gil() )
+        .def( "summary", &Laplacian<Dim, Order>::summary, release_gil() )
         .def( "specs", &Laplacian<Dim, Order>::specs, "Return the json specification of the Laplacian instance" )
         .def( "setSpecs", &Laplacian<Dim, Order>::setSpecs, "Set the json specification of the Laplacian instance" )
         .def( "mesh", &Laplacian<Dim, Order>::mesh, "Return the mesh" )
         .def( "setMesh", &Laplacian<Dim, Order>::setMesh, "Set the mesh" )
         .def( "Xh", &Laplacian<Dim, Order>::Xh, "Return the function space" )
         .def(
-            "u", []( Laplacian<Dim, Order>& l )
+            "u", []( Laplacian<Dim, Order>& l ) -> typename Laplacian<Dim, Order>::element_t&
             { return l.u(); },
-            "Return the element u" )
+            py::return_value_policy::reference_internal,
+            "Return the element u, valid as long as the Laplacian instance" )
+        .def(
+            "uArray", []( py::object self )
+            { return localArray( self.cast<Laplacian<Dim, Order>&>().u(), self ); },
+            "Return a numpy view without copy of the local values of u, ghosts included, valid until the space changes, e.g. with the mesh or the levelset" )
+        .def(
+            "setUFromArray", []( Laplacian<Dim, Order>& l, py::array_t<double, py::array::c_style | py::array::forcecast> a )
+            {
+                auto& u = l.u();
+                std::size_t n = u.map().nLocalDofWithGhost();
+                if ( static_cast<std::size_t>( a.size() ) != n )
+                    throw std::invalid_argument( fmt::format( "expected {} local values (ghosts included), got {}", n, a.size() ) );
+                double const* values = a.data();
+                for ( std::size_t i = 0; i < n; ++i )
+                    u( i ) = values[i];
+            },
+            "Set the local values of u, ghosts included, from a numpy array", py::arg( "values" ) )
         .def( "setU", &Laplacian<Dim, Order>::setU, "Set the element u" )
         .def( "measures", &Laplacian<Dim, Order>::measures, "Return the measures" )
-        .def( "writeResultsToFile", &Laplacian<Dim, Order>::writeResultsToFile, "Write the results to file" )
-        .def( "assembleGradGrad", &Laplacian<Dim, Order>::assembleGradGrad, "assemble grad.grad terms", py::arg( "markers" ), py::arg( "coeffs" ) = Eigen::MatrixXd::Ones( Dim, Dim ) )
-        .def( "assembleMass", &Laplacian<Dim, Order>::assembleMass, "assemble mass terms", py::arg( "markers" ), py::arg( "coeffs" ) = 1 )
-        .def( "assembleFlux", &Laplacian<Dim, Order>::assembleFlux, "assemble flux terms", py::arg( "markers" ), py::arg( "coeffs" ) = 1 );
+        .def(
+            "measuresArray", []( Laplacian<Dim, Order> const& l, std::string const& name )
+            { return columnArray( l.measuresStore().values( name ) ); },
+            "Return a numpy array of the values of the measure name", py::arg( "name" ) )
+        .def(
+            "measuresArrays", []( Laplacian<Dim, Order> const& l )
+            {
+                auto const& store = l.measuresStore();
+                py::dict d;
+                for ( auto const& name : store.names() )
+                    d[py::str( name )] = columnArray( store.values( name ) );
+                return d;
+            },
+            "Return a dict of numpy arrays of the values of the measures" )
+        .def_static( "clearCache", &Laplacian<Dim, Order>::clearCache, "Release the meshes and spaces shared by the instances", release_gil() )
+        .def( "solveBatch", &Laplacian<Dim, Order>::solveBatch,
+              "Solve for a list of json merge patches of the specs sharing the mesh and the space, return the final solutions stacked by row",
+              py::arg( "overrides" ), release_gil() )
+        .def( "isMatrixFree", &Laplacian<Dim, Order>::isMatrixFree, "Return true if the operator is applied without assembled matrix, it is then preconditioned from the P1 matrix of the low order refined elements, or by Jacobi with /Solver/laplacian/low_order_preconditioner false" )
+        .def( "solverStats", &Laplacian<Dim, Order>::solverStats, "Return the linear solver setup and solve statistics" )
+        .def( "timings", &Laplacian<Dim, Order>::timings, "Return the timers and counters of the phases aggregated over the ranks as min, max and mean", release_gil() )
+        .def( "setTrace", &Laplacian<Dim, Order>::setTrace, "Record the timed phases for writeTrace", py::arg( "trace" ) = true )
+        .def( "writeTrace", &Laplacian<Dim, Order>::writeTrace, "Write the timed phases as a Chrome trace json file", py::arg( "filename" ), release_gil() )
+        .def( "writeResultsToFile", &Laplacian<Dim, Order>::writeResultsToFile, "Write the results to file", release_gil() )
+        .def( "assembleGradGrad", py::overload_cast<std::vector<std::string> const&, Eigen::MatrixXd const&>( &Laplacian<Dim, Order>::assembleGradGrad ),
+              "assemble grad.grad terms", py::arg( "markers" ), py::arg( "coeffs" ) = Eigen::MatrixXd::Ones( Dim, Dim ), release_gil() )
+        .def( "assembleMass", py::overload_cast<std::vector<std::string> const&, double>( &Laplacian<Dim, Order>::assembleMass ),
+              "assemble mass terms", py::arg( "markers" ), py::arg( "coeffs" ) = 1, release_gil() )
+        .def( "assembleFlux", py::overload_cast<std::vector<std::string> const&, double>( &Laplacian<Dim, Order>::assembleFlux ),
+              "assemble flux terms", py::arg( "markers" ), py::arg( "coeffs" ) = 1, release_gil() )
+        .def( "newMatrix", &Laplacian<Dim, Order>::newMatrix, "Return a zero matrix with the sparsity pattern of the space, to be reused by the assemble*Into methods", release_gil() )
+        .def( "newVector", &Laplacian<Dim, Order>::newVector, "Return a zero vector of the space, to be reused by assembleFluxInto", release_gil() )
+        .def( "assembleGradGradInto", py::overload_cast<sparse_matrix_ptrtype const&, std::vector<std::string> const&, Eigen::MatrixXd const&, bool>( &Laplacian<Dim, Order>::assembleGradGrad ),
+              "assemble grad.grad terms into matrix, zeroed first unless add, return matrix",
+              py::arg( "matrix" ), py::arg( "markers" ), py::arg( "coeffs" ) = Eigen::MatrixXd::Ones( Dim, Dim ), py::arg( "add" ) = false, release_gil() )
+        .def( "assembleMassInto", py::overload_cast<sparse_matrix_ptrtype const&, std::vector<std::string> const&, double, bool>( &Laplacian<Dim, Order>::assembleMass ),
+              "assemble mass terms into matrix, zeroed first unless add, return matrix",
+              py::arg( "matrix" ), py::arg( "markers" ), py::arg( "coeffs" ) = 1, py::arg( "add" ) = false, release_gil() )
+        .def( "assembleFluxInto", py::overload_cast<vector_ptrtype const&, std::vector<std::string> const&, double, bool>( &Laplacian<Dim, Order>::assembleFlux ),
+              "assemble flux terms into vector, zeroed first unless add, return vector",
+              py::arg( "vector" ), py::arg( "markers" ), py::arg( "coeffs" ) = 1, py::arg( "add" ) = false, release_gil() );
+
+    using rb_t = ReducedBasis<Dim, Order>;
+    py::class_<typename rb_t::Online>( m, fmt::format( "ReducedBasisOnline{}DP{}", Dim, Order ).c_str() )
+        .def_readonly( "output", &rb_t::Online::output )
+        .def_readonly( "outputBound", &rb_t::Online::outputBound )
+        .def_readonly( "errorBound", &rb_t::Online::errorBound )
+        .def_readonly( "coefficients", &rb_t::Online::coefficients );
+    py::class_<rb_t, std::unique_ptr<rb_t, LockedDelete<rb_t>>>( m, fmt::format( "ReducedBasis{}DP{}", Dim, Order ).c_str() )
+        .def( py::init<Laplacian<Dim, Order>&>(), py::keep_alive<1, 2>(), "Build the affine decomposition from an initialized Laplacian", py::arg( "laplacian" ), release_gil() )
+        .def( "nParameters", &rb_t::nParameters, "Return the number of parameters" )
+        .def( "parameterNames", &rb_t::parameterNames, "Return the names of the parameters: the materials then h" )
+        .def( "size", &rb_t::size, "Return the size of the reduced basis" )
+        .def( "setOutput", &rb_t::setOutput, "Set the markers of the output functional", py::arg( "markers" ) )
+        .def( "setReferenceParameter", &rb_t::setReferenceParameter, "Set the parameter defining the inner product", py::arg( "mu" ) )
+        .def( "offline", &rb_t::offline, "Build the reduced basis with a greedy algorithm",
+              py::arg( "muMin" ), py::arg( "muMax" ), py::arg( "nmax" ) = 20, py::arg( "tol" ) = 1e-6, py::arg( "ntrain" ) = 1000, py::arg( "seed" ) = 0, release_gil() )
+        .def( "online", &rb_t::online, "Solve the reduced problem at mu", py::arg( "mu" ) )
+        .def( "expand", &rb_t::expand, "Return the finite element field of the reduced coefficients", py::arg( "coefficients" ), release_gil() )
+        .def( "truth", &rb_t::truth, "Return the finite element solution at mu", py::arg( "mu" ), release_gil() );
+
+    using amr_t = MeshAdaptation<Dim, Order>;
+    py::class_<amr_t>( m, fmt::format( "MeshAdaptation{}DP{}", Dim, Order ).c_str() )
+        .def( py::init<Laplacian<Dim, Order>&>(), py::keep_alive<1, 2>(), "Adapt the mesh of a Laplacian with the options of /Adaptivity/laplacian", py::arg( "laplacian" ) )
+        .def( "run", &amr_t::run, "Solve, estimate, mark and remesh until the measures of interest converge", release_gil() )
+        .def( "history", &amr_t::history, "Return the window, iteration, time, elements, dofs, estimate and measures of interest of each solve" );
 }
 PYBIND11_MODULE(_laplacian, m )
 {
     if (import_mpi4py()<0) return ;
     m.doc() = fmt::format("Python bindings for Laplacian class" );  // Optional module docstring
+    m.def( "concurrentSolves", &Feel::concurrentSolves, "Return true if instances solve at the same time in several threads, otherwise they take turns" );
     laplacian_inst<2,1>(m);
     laplacian_inst<2,2>(m);
-//    laplacian_inst<2,3>(m);
-//    laplacian_inst<3,1>(m);
-//    laplacian_inst<3,2>(m);
+    // high orders are meant to be run with /Solver/laplacian/matrix_free
+    laplacian_inst<2,3>(m);
+    laplacian_inst<3,1>(m);
+    laplacian_inst<3,2>(m);
 }
@@ -0,0 +1,200 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief decimated and asynchronous export of fields
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-05
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <feel/feelcore/environment.hpp>
+#include <feel/feelcore/json.hpp>
+#include <feel/feelfilters/exporter.hpp>
+
+#include "threading.hpp"
+
+namespace Feel
+{
+/**
+ * @brief when to export the fields during a time loop
+ *
+ * read from /PostProcess/<model>/Exports:
+ * - "mode": "all" (default) exports at the steps selected by "every" or "dt",
+ *   "final" exports only the final state and "none" disables the field export
+ * - "every": export every N steps
+ * - "dt": export when at least dt has elapsed since the last export
+ * - "async": write the fields on a background thread, serial runs only: in
+ *   parallel the fields are written synchronously, see AsyncExporter. It
+ *   overlaps the writes of a single process run, e.g. a notebook or a
+ *   parameter study of small cases, not of the parallel production runs
+ * - "queue": maximum number of pending snapshots before the solver blocks, async only
+ * - "name": name of the exported files, the instances of a process need
+ *   distinct names to write at the same time
+ */
+struct ExportPolicy
+{
+    enum class Mode
+    {
+        All,
+        Final,
+        None
+    };
+    Mode mode = Mode::All;
+    int every = 1;
+    double dt = 0;
+    bool async = false;
+    int queue = 2;
+    std::string name;
+
+    ExportPolicy() = default;
+    explicit ExportPolicy( nl::json const& j )
+    {
+        auto m = j.value( "mode", std::string( "all" ) );
+        mode = ( m == "final" ) ? Mode::Final : ( m == "none" ) ? Mode::None : Mode::All;
+        every = std::max( 1, j.value( "every", 1 ) );
+        dt = j.value( "dt", 0. );
+        async = j.value( "async", false );
+        queue = std::max( 1, j.value( "queue", 2 ) );
+        name = j.value( "name", std::string() );
+    }
+
+    /**
+     * @param step index of the step since the start of the time loop
+     * @param t current time
+     * @param tlast time of the last export, -inf if none
+     * @return true if the fields should be exported at this step
+     */
+    bool shouldExport( int step, double t, double tlast ) const
+    {
+        if ( mode != Mode::All )
+            return false;
+        if ( dt > 0 )
+            return t - tlast >= dt * ( 1 - 1e-10 );
+        return step % every == 0;
+    }
+};
+
+/**
+ * @brief write fields to an exporter, possibly on a background thread
+ *
+ * The fields are snapshot copies so that the solver can go on updating its
+ * unknowns. The solver blocks only when the queue of pending snapshots is full.
+ *
+ * Exporters use collective MPI communications on the mesh communicator, which
+ * must not overlap with the solver communications on the same communicator,
+ * and the Feel++ exporters cannot be given another one. The writes are
+ * therefore asynchronous only in serial runs with MPI_THREAD_MULTIPLE
+ * support, otherwise they are done synchronously in push(). The applications
+ * request it with MPIThreadMultiple, Python with mpi4py.
+ */
+template <typename MeshType, typename ElementType>
+class AsyncExporter
+{
+public:
+    using exporter_ptrtype = std::shared_ptr<Exporter<MeshType>>;
+
+    AsyncExporter( exporter_ptrtype const& e, bool async, int capacity )
+        : e_( e ), capacity_( capacity )
+    {
+        int provided = MPI_THREAD_SINGLE;
+        MPI_Query_thread( &provided );
+        async_ = async && Environment::numberOfProcessors() == 1 && provided == MPI_THREAD_MULTIPLE;
+        if ( async && !async_ )
+            LOG( WARNING ) << "asynchronous export is for serial runs with MPI_THREAD_MULTIPLE only, export synchronously";
+        if ( async_ )
+            worker_ = std::thread( [this] { this->run(); } );
+    }
+    AsyncExporter( AsyncExporter const& ) = delete;
+    AsyncExporter& operator=( AsyncExporter const& ) = delete;
+    ~AsyncExporter() { finish(); }
+
+    bool isAsync() const { return async_; }
+
+    //! export a snapshot of @p u at time @p t
+    void push( double t, ElementType const& u )
+    {
+        if ( !async_ )
+        {
+            write( t, u );
+            return;
+        }
+        std::unique_lock<std::mutex> lock( mutex_ );
+        full_.wait( lock, [this] { return static_cast<int>( queue_.size() ) < capacity_; } );
+        queue_.emplace_back( t, u );
+        lock.unlock();
+        ready_.notify_one();
+    }
+
+    //! wait for the pending snapshots to be written and stop the background thread
+    void finish()
+    {
+        if ( !worker_.joinable() )
+            return;
+        {
+            std::lock_guard<std::mutex> lock( mutex_ );
+            done_ = true;
+        }
+        ready_.notify_one();
+        worker_.join();
+    }
+
+private:
+    void write( double t, ElementType const& u )
+    {
+        e_->step( t )->addRegions();
+        e_->step( t )->add( "u", u );
+        e_->save();
+    }
+
+    void run()
+    {
+        for ( ;; )
+        {
+            std::unique_lock<std::mutex> lock( mutex_ );
+            ready_.wait( lock, [this] { return done_ || !queue_.empty(); } );
+            if ( queue_.empty() )
+                return;
+            auto snapshot = std::move( queue_.front() );
+            queue_.pop_front();
+            lock.unlock();
+            full_.notify_one();
+            write( snapshot.first, snapshot.second );
+        }
+    }
+
+    exporter_ptrtype e_;
+    bool async_ = false;
+    int capacity_;
+    std::thread worker_;
+    std::mutex mutex_;
+    std::condition_variable ready_, full_;
+    std::deque<std::pair<double, ElementType>> queue_;
+    bool done_ = false;
+};
+
+} // namespace Feel
@@ -0,0 +1,135 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief source term assembled once and added to the right hand side of a toolbox
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-19
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <feel/feelalg/backend.hpp>
+#include <feel/feelvf/vf.hpp>
+#include <fmt/core.h>
+
+#include "materials.hpp"
+
+namespace Feel
+{
+/**
+ * @brief source term f of the right hand side int_Omega f v for linear assembly hooks
+ *
+ * The expression is parsed once. If it depends neither on the time t nor on
+ * the symbols of the unknowns, its vector is assembled on the first call and
+ * later calls add it to the right hand side with one AXPY. Otherwise it is
+ * integrated into the right hand side at each call, after the time and the
+ * parameters were updated.
+ *
+ * @code
+ * CachedSourceTerm<space_t> source( Xh, soption( "myexpr" ) );
+ * auto hook = [&]( FeelModels::ModelAlgebraic::DataUpdateLinear& data ) {
+ *     if ( !data.buildCstPart() )
+ *         source.addTo( data.rhs(), toolbox->time() );
+ * };
+ * @endcode
+ */
+template <typename SpaceType>
+class CachedSourceTerm
+{
+public:
+    using space_ptrtype = std::shared_ptr<SpaceType>;
+    using expr_type = decltype( expr( std::string() ) );
+
+    /**
+     * @param Xh space of the test functions
+     * @param e expression string, e.g. "3*x*y:x:y"
+     * @param unknowns symbols of the expression standing for the unknowns, set with setParameterValues()
+     */
+    CachedSourceTerm( space_ptrtype Xh, std::string const& e, std::vector<std::string> const& unknowns = {} )
+        : Xh_( std::move( Xh ) ),
+          str_( e ),
+          expr_( parseExpr( e ) ),
+          variable_( dependsOn( e, "t" ) || std::any_of( unknowns.begin(), unknowns.end(), [&e]( auto const& s ) { return dependsOn( e, s ); } ) )
+    {
+    }
+
+    std::string const& string() const { return str_; }
+    //! @return true if the term is assembled at each call
+    bool isVariable() const { return variable_; }
+    //! number of assemblies of the term
+    int assemblies() const { return assemblies_; }
+
+    //! set the value of symbols of the expression, the cached vector is assembled again
+    void setParameterValues( std::map<std::string, double> const& mp )
+    {
+        expr_.setParameterValues( mp );
+        b_.reset();
+    }
+
+    /**
+     * @brief add the term to @p F
+     *
+     * @param F right hand side, may hold values added but not yet assembled
+     * @param t time at which a time dependent term is evaluated
+     */
+    void addTo( vector_ptrtype const& F, double t = 0 )
+    {
+        if ( variable_ )
+        {
+            if ( dependsOn( str_, "t" ) )
+                expr_.setParameterValues( { { "t", t } } );
+            assemble( F );
+            return;
+        }
+        if ( !b_ )
+        {
+            b_ = backend()->newVector( Xh_ );
+            assemble( b_ );
+            b_->close();
+        }
+        // the axpy needs the values pending in F
+        F->close();
+        F->add( 1., *b_ );
+    }
+
+private:
+    void assemble( vector_ptrtype const& F )
+    {
+        auto v = Xh_->element();
+        auto f = form1( _test = Xh_, _vector = F );
+        f += integrate( _range = elements( support( Xh_ ) ), _expr = inner( expr_, id( v ) ) );
+        ++assemblies_;
+    }
+
+    space_ptrtype Xh_;
+    std::string str_;
+    expr_type expr_;
+    bool variable_ = false;
+    vector_ptrtype b_;
+    int assemblies_ = 0;
+};
+
+} // namespace Feel
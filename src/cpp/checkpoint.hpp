@@ -0,0 +1,186 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief per-rank binary checkpoints of the time stepping state
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-18
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <feel/feelcore/json.hpp>
+#include <fmt/core.h>
+
+namespace Feel
+{
+/**
+ * @brief checkpoints of a set of fields written by each rank
+ *
+ * A checkpoint is a directory step-<n> holding one file rank-<r>.bin per rank
+ * and meta.json. A rank file is made of the magic string "FPCKPT1\n", the
+ * number of fields and of values per field as int64, and then the values of
+ * each field in turn. The file latest.json of the checkpoint directory names
+ * the last complete checkpoint: it is replaced once all the ranks wrote their
+ * file, so that a job killed while writing restarts from the previous one.
+ * Only the last @c keep checkpoints are kept on disk.
+ *
+ * The fields are the local values of the rank, ghosts included, a checkpoint
+ * is read back with the same number of ranks and the same mesh partitioning.
+ */
+class CheckpointStore
+{
+public:
+    static constexpr char magic[] = "FPCKPT1\n";
+
+    CheckpointStore() = default;
+    CheckpointStore( std::string directory, MPI_Comm comm, int keep = 2 )
+        : dir_( std::move( directory ) ), comm_( comm ), keep_( std::max( 1, keep ) )
+    {
+    }
+
+    std::string const& directory() const { return dir_; }
+
+    //! @return true if the directory holds a complete checkpoint
+    bool exists() const { return std::filesystem::exists( std::filesystem::path( dir_ ) / "latest.json" ); }
+
+    /**
+     * @brief write a checkpoint, collective
+     *
+     * @param step number of the checkpoint, e.g. the time step
+     * @param meta data of the checkpoint, e.g. time and order of the scheme
+     * @param fields local values of the fields of the rank
+     */
+    void write( int step, nl::json meta, std::vector<std::vector<double>> const& fields ) const
+    {
+        namespace fs = std::filesystem;
+        int rank, size;
+        MPI_Comm_rank( comm_, &rank );
+        MPI_Comm_size( comm_, &size );
+        auto name = fmt::format( "step-{:08d}", step );
+        fs::path d = fs::path( dir_ ) / name;
+        if ( rank == 0 )
+            fs::create_directories( d );
+        MPI_Barrier( comm_ );
+
+        auto file = d / fmt::format( "rank-{:05d}.bin", rank );
+        {
+            std::ofstream out( file.string() + ".tmp", std::ios::binary );
+            if ( !out )
+                throw std::runtime_error( fmt::format( "Unable to open file: {}", file.string() ) );
+            out.write( magic, sizeof( magic ) - 1 );
+            std::int64_t nfields = fields.size(), n = fields.empty() ? 0 : fields.front().size();
+            out.write( reinterpret_cast<char const*>( &nfields ), sizeof( nfields ) );
+            out.write( reinterpret_cast<char const*>( &n ), sizeof( n ) );
+            for ( auto const& f : fields )
+            {
+                if ( static_cast<std::int64_t>( f.size() ) != n )
+                    throw std::invalid_argument( "checkpoint: the fields must have the same size" );
+                out.write( reinterpret_cast<char const*>( f.data() ), n * sizeof( double ) );
+            }
+            if ( !out )
+                throw std::runtime_error( fmt::format( "Unable to write file: {}", file.string() ) );
+        }
+        fs::rename( file.string() + ".tmp", file );
+        MPI_Barrier( comm_ );
+
+        if ( rank == 0 )
+        {
+            meta["name"] = name;
+            meta["step"] = step;
+            meta["nprocs"] = size;
+            meta["nfields"] = fields.size();
+            std::ofstream( d / "meta.json" ) << meta.dump( 2 );
+            auto latest = fs::path( dir_ ) / "latest.json";
+            std::ofstream( latest.string() + ".tmp" ) << meta.dump( 2 );
+            fs::rename( latest.string() + ".tmp", latest );
+            prune();
+        }
+        MPI_Barrier( comm_ );
+    }
+
+    /**
+     * @brief read the last complete checkpoint
+     *
+     * @param n expected number of values per field of the rank
+     * @return the data of the checkpoint, the fields are stored in @p fields
+     */
+    nl::json read( std::size_t n, std::vector<std::vector<double>>& fields ) const
+    {
+        namespace fs = std::filesystem;
+        int rank, size;
+        MPI_Comm_rank( comm_, &rank );
+        MPI_Comm_size( comm_, &size );
+        fs::path latest = fs::path( dir_ ) / "latest.json";
+        std::ifstream lin( latest );
+        if ( !lin )
+            throw std::runtime_error( fmt::format( "no checkpoint in {}", dir_ ) );
+        auto meta = nl::json::parse( lin );
+        if ( meta["nprocs"].get<int>() != size )
+            throw std::runtime_error( fmt::format( "checkpoint {} written with {} ranks, read with {}", dir_, meta["nprocs"].get<int>(), size ) );
+
+        auto file = fs::path( dir_ ) / meta["name"].get<std::string>() / fmt::format( "rank-{:05d}.bin", rank );
+        std::ifstream in( file, std::ios::binary );
+        char m[sizeof( magic ) - 1];
+        std::int64_t nfields = 0, nvalues = 0;
+        in.read( m, sizeof( m ) );
+        in.read( reinterpret_cast<char*>( &nfields ), sizeof( nfields ) );
+        in.read( reinterpret_cast<char*>( &nvalues ), sizeof( nvalues ) );
+        if ( !in || std::string( m, sizeof( m ) ) != magic )
+            throw std::runtime_error( fmt::format( "{} is not a checkpoint file", file.string() ) );
+        if ( static_cast<std::size_t>( nvalues ) != n )
+            throw std::runtime_error( fmt::format( "checkpoint {} has {} values per field instead of {}, the mesh or its partitioning differ", file.string(), nvalues, n ) );
+        fields.assign( nfields, std::vector<double>( n ) );
+        for ( auto& f : fields )
+            in.read( reinterpret_cast<char*>( f.data() ), n * sizeof( double ) );
+        if ( !in )
+            throw std::runtime_error( fmt::format( "checkpoint file {} is truncated", file.string() ) );
+        return meta;
+    }
+
+private:
+    //! remove all but the last keep checkpoints
+    void prune() const
+    {
+        namespace fs = std::filesystem;
+        std::vector<fs::path> steps;
+        for ( auto const& e : fs::directory_iterator( dir_ ) )
+            if ( e.is_directory() && e.path().filename().string().rfind( "step-", 0 ) == 0 )
+                steps.push_back( e.path() );
+        std::sort( steps.begin(), steps.end() );
+        for ( std::size_t i = 0; i + keep_ < steps.size(); ++i )
+            fs::remove_all( steps[i] );
+    }
+
+    std::string dir_;
+    MPI_Comm comm_ = MPI_COMM_NULL;
+    int keep_ = 2;
+};
+
+} // namespace Feel
@@ -22,32 +22,171 @@
 //! @copyright 2023 Feel++ Consortium
 //! @copyright 2023 Université de Strasbourg
 //!
+#include <filesystem>
+#include <fstream>
 #include "laplacian.hpp"
+#include "meshadaptation.hpp"
+
+namespace Feel
+{
+//! run the laplacian described by @p specs and return its measures
+template <int Dim, int Order>
+MeasuresStore runLaplacian( nl::json const& specs )
+{
+    Laplacian<Dim, Order> laplacian( specs );
+    if ( AdaptationOptions( get_value( specs, "/Adaptivity/laplacian", nl::json() ) ).enabled )
+        MeshAdaptation<Dim, Order>( laplacian ).run();
+    else
+        laplacian.run();
+    return laplacian.measuresStore();
+}
+
+//! instantiations available at runtime, see laplacian_inst.cpp.in
+inline std::map<std::pair<int, int>, MeasuresStore ( * )( nl::json const& )> const& laplacianRunners()
+{
+    static const std::map<std::pair<int, int>, MeasuresStore ( * )( nl::json const& )> runners = {
+        { { 2, 1 }, &runLaplacian<2, 1> },
+        { { 2, 2 }, &runLaplacian<2, 2> },
+        { { 2, 3 }, &runLaplacian<2, 3> },
+        { { 3, 1 }, &runLaplacian<3, 1> },
+        { { 3, 2 }, &runLaplacian<3, 2> } };
+    return runners;
+}
+
+inline nl::json loadSpecs( std::string const& filename )
+{
+    std::istringstream istr( removeComments( readFromFile( Environment::expand( filename ) ) ) );
+    return nl::json::parse( istr );
+}
+
+/**
+ * @brief dimension and order of the run, read before the environment which
+ * names the application after them
+ *
+ * The command line takes precedence over the config file, then over
+ * /Spaces/laplacian of the specs, $cfgdir being the only expanded variable.
+ * Falls back to FEELPP_DIM and FEELPP_ORDER when they cannot be read.
+ */
+inline std::pair<int, int> parseDimOrder( int argc, char** argv )
+{
+    int dim = 0, order = 0;
+    try
+    {
+        po::options_description desc;
+        desc.add_options()
+            ( "config-file", po::value<std::string>() )
+            ( "specs", po::value<std::string>() )
+            ( "dim", po::value<int>()->default_value( 0 ) )
+            ( "order", po::value<int>()->default_value( 0 ) );
+        po::variables_map vm;
+        po::store( po::command_line_parser( argc, argv ).options( desc ).allow_unregistered().run(), vm );
+        std::string cfgdir = ".";
+        if ( vm.count( "config-file" ) && std::filesystem::exists( vm["config-file"].as<std::string>() ) )
+        {
+            std::filesystem::path cfg = vm["config-file"].as<std::string>();
+            cfgdir = std::filesystem::absolute( cfg ).parent_path().string();
+            std::ifstream ifs( cfg );
+            po::store( po::parse_config_file( ifs, desc, true ), vm );
+        }
+        dim = vm["dim"].as<int>();
+        order = vm["order"].as<int>();
+        if ( ( dim <= 0 || order <= 0 ) && vm.count( "specs" ) )
+        {
+            std::string filename = vm["specs"].as<std::string>();
+            if ( auto pos = filename.find( "$cfgdir" ); pos != std::string::npos )
+                filename.replace( pos, 7, cfgdir );
+            if ( std::filesystem::exists( filename ) )
+            {
+                std::istringstream istr( removeComments( readFromFile( filename ) ) );
+                auto specs = nl::json::parse( istr );
+                if ( dim <= 0 )
+                    dim = get_value( specs, "/Spaces/laplacian/dim", 0 );
+                if ( order <= 0 )
+                    order = get_value( specs, "/Spaces/laplacian/order", 0 );
+            }
+        }
+    }
+    catch ( std::exception const& )
+    {
+        // the environment reports the invalid options and specs
+    }
+    return { dim > 0 ? dim : FEELPP_DIM, order > 0 ? order : FEELPP_ORDER };
+}
+
+/**
+ * @brief compare the measures of a run with the ones of the reference run
+ * described by the option compare.specs, in memory and in the streamed file
+ *
+ * @return 0 if both runs agree, 1 otherwise
+ */
+inline int compareWithReference( nl::json const& specs, MeasuresStore const& meas,
+                                 MeasuresStore ( *runner )( nl::json const& ) )
+{
+    if ( soption( "compare.specs" ).empty() )
+        return 0;
+    auto reference = runner( loadSpecs( soption( "compare.specs" ) ) );
+    int status = 0;
+    try
+    {
+        auto rows = compareMeasures( meas, reference, doption( "compare.rtol" ), doption( "compare.atol" ) );
+        LOG( INFO ) << fmt::format( "{} rows in memory agree with the reference run", rows );
+        // the streamed file, e.g. the whole history of a restarted run, holds every row
+        auto filename = get_value( specs, "/PostProcess/laplacian/Measures/filename", std::string{} );
+        if ( !filename.empty() && Environment::isMasterRank() )
+        {
+            auto stored = MeasuresStore::read( filename );
+            if ( stored.contains( "time" ) && reference.contains( "time" ) && stored.values( "time" ).size() != reference.values( "time" ).size() )
+                throw std::runtime_error( fmt::format( "{} holds {} rows instead of {}", filename, stored.values( "time" ).size(), reference.values( "time" ).size() ) );
+            rows = compareMeasures( stored, reference, doption( "compare.rtol" ), doption( "compare.atol" ) );
+            std::cout << fmt::format( "[laplacian] {}: {} rows agree with the reference run", filename, rows ) << std::endl;
+        }
+    }
+    catch ( std::runtime_error const& e )
+    {
+        std::cerr << fmt::format( "[laplacian] {}", e.what() ) << std::endl;
+        status = 1;
+    }
+    return mpi::all_reduce( Environment::worldComm(), status, mpi::maximum<int>() );
+}
+} // namespace Feel
 
 int main(int argc, char** argv)
 {
     using namespace Feel;
+    // before the environment, for the asynchronous exports of the serial runs
+    MPIThreadMultiple mpi( argc, argv );
     int status;
     try
     {
+        // one application, hence one repository, per dimension and order
+        auto [appDim, appOrder] = parseDimOrder( argc, argv );
         Environment env(_argc = argc, _argv = argv,
                         _desc = makeOptions(),
-                        _about = about(_name = fmt::format("laplacian-{}dp{}", FEELPP_DIM, FEELPP_ORDER),
+                        _about = about(_name = fmt::format( "laplacian-{}dp{}", appDim, appOrder ),
                                        _author = "Feel++ Consortium",
                                        _email = "feelpp@cemosis.fr"));
-        auto jsonfile = removeComments(readFromFile(Environment::expand(soption("specs"))));
-        std::istringstream istr(jsonfile);
-        json specs = json::parse(istr);
+        json specs = loadSpecs( soption( "specs" ) );
 
-        // Create an instance of the Laplacian class
-        Laplacian<FEELPP_DIM, FEELPP_ORDER> laplacian(specs);
+        // the options take precedence over the specs
+        int dim = ioption( "dim" ) > 0 ? ioption( "dim" ) : get_value( specs, "/Spaces/laplacian/dim", FEELPP_DIM );
+        int order = ioption( "order" ) > 0 ? ioption( "order" ) : get_value( specs, "/Spaces/laplacian/order", FEELPP_ORDER );
+        auto runner = laplacianRunners().find( { dim, order } );
+        if ( runner == laplacianRunners().end() )
+            throw std::invalid_argument( fmt::format( "laplacian in dimension {} with order {} is not available", dim, order ) );
+        LOG( INFO ) << fmt::format( "laplacian in dimension {} with order {}", dim, order );
+        if ( dim != appDim || order != appOrder )
+            LOG( WARNING ) << fmt::format( "laplacian in dimension {} with order {} runs in the repository of laplacian-{}dp{}, "
+                                           "set --dim and --order on the command line",
+                                           dim, order, appDim, appOrder );
 
-        // Call the run method on the Laplacian instance
-        laplacian.run();
+        // Create an instance of the Laplacian class and call its run method
+        auto meas = runner->second( specs );
+        status = compareWithReference( specs, meas, runner->second );
     }
     catch (...)
     {
         handleExceptions();
+        status = 1;
     }
-    return 0;
+    return status;
 }
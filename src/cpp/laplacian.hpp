@@ -23,8 +23,12 @@
 //! @copyright 2023 Université de Strasbourg
 //!
 #pragma once
+#include <filesystem>
 #include <iostream>
+#include <optional>
+#include <stdexcept>
 
+#include <feel/feelalg/backend.hpp>
 #include <feel/feelalg/matrixpetsc.hpp>
 #include <feel/feelalg/topetsc.hpp>
 #include <feel/feelalg/vectorpetsc.hpp>
@@ -33,7 +37,9 @@
 #include <feel/feelcore/ptreetools.hpp>
 #include <feel/feelcore/utility.hpp>
 #include <feel/feeldiscr/minmax.hpp>
+#include <feel/feeldiscr/operatorinterpolation.hpp>
 #include <feel/feeldiscr/pch.hpp>
+#include <feel/feeldiscr/pdh.hpp>
 #include <feel/feelfilters/exporter.hpp>
 #include <feel/feelfilters/loadmesh.hpp>
 #include <feel/feelts/bdf.hpp>
@@ -43,8 +49,21 @@
 #include <fmt/core.h>
 #include <fmt/ostream.h>
 
+#include "asyncexporter.hpp"
+#include "checkpoint.hpp"
+#include "levelsetdomain.hpp"
+#include "linearsolver.hpp"
+#include "matrixfree.hpp"
+#include "materials.hpp"
+#include "measures.hpp"
+#include "meshcache.hpp"
+#include "threading.hpp"
+#include "timers.hpp"
+#include "timestepcontrol.hpp"
+
 namespace Feel
 {
+//! default dimension and order, see laplacianRunners() in laplacian.cpp
 inline const int FEELPP_DIM=2;
 inline const int FEELPP_ORDER=1;
 
@@ -97,7 +116,20 @@ makeOptions()
           "json spec file for rht" )
 
         ( "steady", Feel::po::value<bool>()->default_value( 1 ),
-          "if 1: steady else unsteady" );
+          "if 1: steady else unsteady" )
+
+        ( "dim", Feel::po::value<int>()->default_value( 0 ),
+          "dimension, if 0 read from /Spaces/laplacian/dim in the specs" )
+        ( "order", Feel::po::value<int>()->default_value( 0 ),
+          "polynomial order, if 0 read from /Spaces/laplacian/order in the specs" )
+
+        // regression checks
+        ( "compare.specs", Feel::po::value<std::string>()->default_value( "" ),
+          "json spec file of a reference run, the measures of both runs are compared at the common times" )
+        ( "compare.rtol", Feel::po::value<double>()->default_value( 1e-5 ),
+          "relative tolerance of the comparison with the reference run" )
+        ( "compare.atol", Feel::po::value<double>()->default_value( 1e-8 ),
+          "absolute tolerance of the comparison with the reference run" );
 
     return options.add( Feel::feel_options() );
 }
@@ -117,6 +149,9 @@ public:
     using space_t = Pch_type<mesh_t, Order>;
     using space_ptr_t = Pch_ptrtype<mesh_t, Order>; // Define the type for Pch_ptrtype
     using element_t = typename space_t::element_type;
+    using p0_space_t = Pdh_type<mesh_t, 0>;
+    using p0_element_t = typename p0_space_t::element_type;
+    using levelset_type = LevelsetDomain<mesh_t>;
     using form2_type = form2_t<space_t,space_t>; // Define the type for form2
     using form1_type = form1_t<space_t>; // Define the type for form1
     using bdf_ptrtype = std::shared_ptr<Bdf<space_t>>;
@@ -138,380 +173,433 @@ public:
     element_t& u() { return u_; }
     element_t const& u() const { return u_; }
     element_t const& v() const { return v_; }
-    form2_type const& a() const { return a_; }
-    form2_type const& at() const { return at_; }
+    //! operator, throws in matrix-free mode where the forms have no matrix
+    form2_type const& a() const { return assembled( a_ ); }
+    form2_type const& at() const { return assembled( frozen_ ? a_ : at_ ); }
+    //! weighted mass rho*Cp used to build the time derivative right hand side
+    form2_type const& m() const { return assembled( m_ ); }
     form1_type const& l() const { return l_; }
     form1_type const& lt() const { return lt_; }
+    //! time scheme, null in the steady case
     bdf_ptrtype const& bdf() const { return bdf_; }
-    exporter_ptrtype const& exporter() const { return e_; }
-    nl::json measures() const { return meas_; }
+    //! @return true if /TimeStepping/laplacian/steady is set, u is then computed with one solve
+    bool isSteady() const { return steady_; }
+    //! time of the current state u
+    double time() const { return time_; }
+    //! number of the time step of u
+    int step() const { return step_; }
+    //! controller of the adaptive time loop read from /TimeStepping/laplacian/adaptive
+    TimeStepController const& timeStepController() const { return adaptive_; }
+    /**
+     * @brief exporter of the fields, created on first use
+     *
+     * it is named after /PostProcess/laplacian/Exports/name, by default the
+     * first instance of the process uses the name of the application and the
+     * next ones append their number so that they do not write the same files
+     */
+    exporter_ptrtype const& exporter() const
+    {
+        if ( !e_ )
+        {
+            if ( !exportPolicy_.name.empty() )
+                e_ = Feel::exporter( _mesh = mesh_, _name = exportPolicy_.name );
+            else if ( id_ > 0 )
+                e_ = Feel::exporter( _mesh = mesh_, _name = fmt::format( "{}-{}", Environment::about().appName(), id_ ) );
+            else
+                e_ = Feel::exporter( _mesh = mesh_ );
+        }
+        return e_;
+    }
+    //! number of the instance in the process, see exporter()
+    int id() const { return id_; }
+    //! json view of the measures, one array per measure
+    nl::json measures() const { return meas_.toJson(); }
+    MeasuresStore const& measuresStore() const { return meas_; }
+    //! @return true if the operator is assembled once and reused for every time step
+    bool isOperatorFrozen() const { return frozen_; }
+    //! material properties parsed from /Materials at initialization
+    std::vector<MaterialProperties> const& materials() const { return materials_; }
+    //! policy of the field export read from /PostProcess/laplacian/Exports
+    ExportPolicy const& exportPolicy() const { return exportPolicy_; }
+    //! measure of the volume and face markers of the mesh, computed once per space
+    std::map<std::string, double> const& markerMeasures() const
+    {
+        if ( !post_ || post_->mesh != mesh_.get() || post_->space.lock() != Xh_ )
+            buildPostProcess();
+        return post_->measures;
+    }
+    /**
+     * @return true if the operator is applied without assembling its matrix, see /Solver/laplacian/matrix_free
+     *
+     * the matrix-free mode is preconditioned by default with GAMG on the P1
+     * matrix of the low order refined elements, see
+     * MatrixFreeOperator::lowOrderMatrix(). With
+     * /Solver/laplacian/low_order_preconditioner false no sparse matrix is
+     * allocated and Jacobi is the default: the iteration counts then grow as
+     * the mesh is refined, noticeably for P3 and for P2 in 3D
+     */
+    bool isMatrixFree() const { return matrixFree_; }
+    //! domain of /Spaces/laplacian/Domain/levelset, null for the other domains
+    std::shared_ptr<levelset_type> const& levelsetDomain() const { return levelset_; }
+    std::shared_ptr<MatrixFreeOperator<space_t>> const& matrixFreeOperator() const { return mf_; }
+    /**
+     * @brief number of threads assembling the constant coefficient terms, see /Solver/laplacian/assembly_threads
+     *
+     * 0 assembles every term with integrate, a positive number or -1 for all
+     * the threads of OpenMP assembles the materials and the Robin conditions
+     * with constant coefficients from the reference element matrices
+     */
+    int assemblyThreads() const { return assemblyThreads_; }
+    //! @return the number of setups and solves and their timings
+    nl::json solverStats() const { return solver_ ? solver_->stats().toJson() : nl::json::object(); }
+    /**
+     * @brief timers and counters of the phases aggregated over the ranks, collective
+     *
+     * the phases are initialize, processMaterials, processBoundaryConditions,
+     * the steps of the time loop with their assembly, solve and export, and
+     * exportResults, the counter ksp.iterations holds the iterations of each solve
+     *
+     * @throw std::logic_error if the instance has no space yet, e.g. a default one
+     */
+    nl::json timings() const { return timings_.toJson( timingsComm() ); }
+    Timings& timingsStore() const { return timings_; }
+    //! write the timed phases as a Chrome trace, collective, see /PostProcess/laplacian/Timings
+    void writeTrace( std::string const& filename ) const { timings_.writeTrace( filename, timingsComm() ); }
+
+    //! release the meshes and spaces shared by the instances, see initializeMesh()
+    static void clearCache()
+    {
+        ObjectCache<space_t>::instance().clear();
+        ObjectCache<mesh_t>::instance().clear();
+    }
 
     // Mutators
     void setSpecs(nl::json const& specs) { specs_ = specs; }
     void setMesh(std::shared_ptr<mesh_t> const& mesh) { mesh_ = mesh; }
     void setU(element_t const& u) { u_ = u; }
+    //! freeze the operator or not, between initialize() and processMaterials()
+    void setOperatorFrozen( bool f ) { frozen_ = f; }
+    void setExportPolicy( ExportPolicy const& p ) { exportPolicy_ = p; }
+    //! record the timed phases for writeTrace(), enabled by /PostProcess/laplacian/Timings/trace
+    void setTrace( bool t ) { timings_.setTrace( t ); }
 
     void initialize();
+    /**
+     * @brief load the mesh
+     *
+     * the mesh is taken from the process-wide cache when an instance already
+     * loaded it with the same specs, and it can be cached on disk with
+     * /Meshes/laplacian/Import/cache
+     */
+    void initializeMesh();
+    /**
+     * @brief build the space on the domain of /Spaces/laplacian/Domain, shared through the cache as the mesh
+     *
+     * the domain is the whole mesh, the elements of "marker" or the part
+     * phi < 0 of "levelset". A levelset domain is updated incrementally in a
+     * narrow band of "band" rings of elements around the interface, the space
+     * is built again only if its elements change, and the elements cut by the
+     * interface are integrated on their part phi < 0 unless "cut_quadrature"
+     * is false, see LevelsetDomain
+     */
+    void initializeSpace();
+    //! create the forms and the time stepping and parse the materials, the state is the initial one
+    void initializeModel();
+    //! create the forms of the operator of the specs and parse the materials, the state is kept
+    void initializeOperator();
     void processMaterials();
     void processBoundaryConditions();
     void run();
     void timeLoop();
-    nl::json exportResults() const { return exportResults( bdf_->time(), u_ ); }
-    nl::json exportResults( double t, element_t const& u ) const;
+    MeasuresStore const& exportResults() const { return exportResults( time_, u_ ); }
+    MeasuresStore const& exportResults( double t, element_t const& u ) const;
     void summary(/*arguments*/);
     void writeResultsToFile(const std::string& filename) const;
     form2_type assembleGradGrad( std::vector<std::string> const& markers, Eigen::MatrixXd const& coeffs );
     form2_type assembleMass( std::vector<std::string> const& markers, double coeff );
     form1_type assembleFlux( std::vector<std::string> const& markers, double coeff );
+    /**
+     * @brief in place variants of the assembly of the terms for repeated assemblies
+     *
+     * the terms are assembled into @p M or @p F, which are zeroed first unless
+     * @p add, keeping their structure: no new graph, allocation or
+     * preallocation. The matrices are created once with newMatrix().
+     *
+     * @return @p M or @p F
+     */
+    sparse_matrix_ptrtype const& assembleGradGrad( sparse_matrix_ptrtype const& M, std::vector<std::string> const& markers, Eigen::MatrixXd const& coeffs, bool add = false );
+    sparse_matrix_ptrtype const& assembleMass( sparse_matrix_ptrtype const& M, std::vector<std::string> const& markers, double coeff, bool add = false );
+    vector_ptrtype const& assembleFlux( vector_ptrtype const& F, std::vector<std::string> const& markers, double coeff, bool add = false );
+    //! zero matrix with the sparsity pattern of the space, the graph is computed once per space
+    sparse_matrix_ptrtype newMatrix() const;
+    vector_ptrtype newVector() const { return backend()->newVector( Xh_ ); }
+
+    /**
+     * @brief check if the bilinear form does not change during the time loop
+     *
+     * the operator is time invariant if none of the coefficients k, rho, Cp of
+     * the materials and h of the Robin conditions depend on the time symbol t
+     */
+    bool isOperatorTimeInvariant() const;
+
+    /**
+     * @brief solve the model for a batch of parameter sets on the same mesh and space
+     *
+     * each override, e.g. {"Materials": {...}, "BoundaryConditions": {...}}, is
+     * merged into the specs as a json merge patch. The samples whose operator
+     * data coincide share the operator and its preconditioner: their time loops
+     * advance together and the right hand sides of a step are solved at once.
+     * The fields are not exported, the measures of the final state of each
+     * sample are available in measures(), one row per sample.
+     *
+     * The model is initialized once: every sample starts from the initial
+     * conditions of the specs, a restart is ignored. The operator of a group
+     * must not depend on time, see isOperatorFrozen(), it is rejected with
+     * std::invalid_argument otherwise. On return the operator is the one of
+     * the specs and the state is the initial one.
+     *
+     * @param overrides one json merge patch of the specs per sample
+     * @return the final solution of each sample, one row per sample with the local values, ghosts included
+     */
+    Eigen::MatrixXd solveBatch( std::vector<nl::json> const& overrides );
+
+    //! u then the previous states of the time scheme, newest first
+    std::vector<element_t> states() const;
+    /**
+     * @brief start the next initialization from @p states instead of the initial conditions or a checkpoint
+     *
+     * the states, see states(), may be defined on another mesh: they are
+     * interpolated on the space of the next initialization, see MeshAdaptation
+     *
+     * @param t time of the states
+     * @param step number of the time step of the states
+     */
+    void setTransferredState( double t, int step, std::vector<element_t> const& states );
+    /**
+     * @brief residual error indicator of u, eta_K^2 per element of the mesh
+     *
+     * eta_K^2 = h_K^2 |div(k grad u)|_K^2 + 1/2 sum of h_F |[k grad u.n]|_F^2
+     * over the interior faces of K + sum of h_F |g - k grad u.n|_F^2 over its
+     * flux and Robin faces, g being the flux or h (Text - u). The terms are
+     * evaluated at the time of u without the time derivative, the domain is
+     * the whole mesh.
+     */
+    p0_element_t errorIndicator() const;
 
     // Accessors and mutators for members
     /* ... */
 
 private:
-    nl::json specs_;
-    std::shared_ptr<mesh_t> mesh_;
-    space_ptr_t Xh_;
-    element_t u_, v_;
-    form2_type a_, at_;
-    form1_type l_, lt_;
-    bdf_ptrtype bdf_;
-    mutable exporter_ptrtype e_;
-    mutable nl::json meas_;
-};
-
-// Constructor
-template <int Dim, int Order>
-Laplacian<Dim, Order>::Laplacian(nl::json const& specs) : specs_(specs)
-{
-    initialize();
-}
-template <int Dim, int Order>
-Laplacian<Dim, Order>::Laplacian( Laplacian const& l )
-    : specs_( l.specs ),
-      mesh_( l.mesh_ ),
-      Xh_( l.Xh_ ),
-      u_( l.u_ ),
-      v_( l.v_ ),
-      a_( form2( _test = Xh_, _trial = Xh_ ) ),
-      at_( form2( _test = Xh_, _trial = Xh_ ) ),
-      l_( form1( _test = Xh_ ) ),
-      lt_( form1( _test = Xh_ ) ),
-      bdf_( l.bdf_ ),
-      e_( Feel::exporter( _mesh = mesh_ ) ),
-      meas_( l.meas_ )
-{
-    a_ = l.a_;
-    at_ = l.at_;
-    l_ = l.l_;
-    lt_ = l.lt_;
-}
-
-template <int Dim, int Order>
-Laplacian<Dim, Order>::Laplacian( Laplacian&& l ) noexcept
-    : specs_( std::move( l.specs_ ) ),
-      mesh_( std::move( l.mesh_ ) ),
-      Xh_( std::move( l.Xh_ ) ),
-      u_( std::move( l.u_ ) ),
-      v_( std::move( l.v_ ) ),
-      a_( std::move( l.a_ ) ),
-      at_( std::move( l.at_ ) ),
-      l_( std::move( l.l_ ) ),
-      lt_( std::move( l.lt_ ) ),
-      bdf_( std::move( l.bdf_ ) ),
-      e_( std::move( l.e_ ) ),
-      meas_( std::move( l.meas_ ) )
-{
-    // Optionally, handle the moved-from state if necessary
-}
-template <int Dim, int Order>
-Laplacian<Dim, Order>&
-Laplacian<Dim, Order>::operator=( Laplacian const& l )
-{
-    if ( this != &l )
+    /**
+     * @brief solve a u = l with the solver kept across time steps
+     *
+     * the solver is configured by /Solver/laplacian in the specs and falls
+     * back on the backend options (ksp-type, pc-type, ...)
+     *
+     * @param operatorChanged if true the preconditioner is set up again
+     */
+    void solve( form2_type& a, form1_type& l, bool operatorChanged );
+    //! @return the linear solver, created on first use
+    LinearSolver& linearSolver();
+    //! @return the Krylov method and the preconditioner of the current model
+    std::pair<std::string, std::string> solverTypes() const;
+    //! @return the PETSc matrix of the operator @p a, or its matrix-free shell
+    Mat operatorMatrix( form2_type& a );
+    //! @return the PETSc matrix of the weighted mass, or its matrix-free shell
+    Mat massMatrix();
+
+    //! @return a time stepping scheme configured by /TimeStepping/laplacian
+    bdf_ptrtype createBdf( std::string const& name ) const;
+    /**
+     * @brief set u from /InitialConditions/laplacian/temperature
+     *
+     * "Expression": {"<name>": {"markers": [...], "expr": "..."}} evaluates the
+     * expressions at the initial time on the markers, or on the whole domain,
+     * and "File": {"checkpoint": "<directory>"} reads the state of the last
+     * checkpoint of a previous run
+     */
+    void applyInitialConditions();
+    /**
+     * @brief checkpoints of the time loop, see /TimeStepping/laplacian/checkpoint
+     *
+     * {"directory": "checkpoints", "every": <steps>, "keep": 2}: every
+     * <steps> time steps and at the end of the time loop, the time, the step
+     * and u with the history of the scheme are written, see CheckpointStore
+     */
+    CheckpointStore checkpointStore() const;
+    bool checkpointDue( bool final ) const;
+    void writeCheckpoint( std::vector<element_t const*> const& states, double dt ) const;
+    /**
+     * @brief resume from the last checkpoint if /TimeStepping/laplacian/restart is set
+     *
+     * true resumes from the checkpoint directory if it holds a checkpoint and
+     * starts from the initial conditions otherwise, a directory resumes from
+     * its checkpoint
+     */
+    void restoreCheckpoint();
+    //! set u, and the history of the scheme in the transient case, from restartStates_ and @p meta: time, step and dt
+    void restoreState( nl::json const& meta );
+    //! interpolate the state of setTransferredState() on the space and restore it
+    void restoreTransferredState();
+    //! local values of @p u, ghosts included
+    static std::vector<double> localValues( element_t const& u );
+    static void setLocalValues( element_t& u, std::vector<double> const& v );
+    //! add the right hand side of the flux and Robin conditions of @p specs to @p l
+    void assembleBoundaryRhs( nl::json const& specs, form1_type& l );
+    /**
+     * @brief time loop with a step chosen by the local error
+     *
+     * the steps are implicit Euler steps with the operator a + (1/dt - c0) M,
+     * c0 being the coefficient of the time derivative in a. The local error is
+     * estimated by the distance to the linear extrapolation of the two previous
+     * states, dt/(dt+dt_prev) |u^{n+1} - u_pred| / |u^{n+1}| in the max norm.
+     * The steps are recorded in the "dt" measure.
+     */
+    void adaptiveTimeLoop();
+    //! add the terms of assembleGradGrad(), assembleMass() and assembleFlux() to a form
+    void addGradGrad( form2_type& a, std::vector<std::string> const& markers, Eigen::MatrixXd const& coeffs );
+    void addMass( form2_type& a, std::vector<std::string> const& markers, double coeff );
+    void addFlux( form1_type& l, std::vector<std::string> const& markers, double coeff );
+    /**
+     * @brief add the terms of a constant material on the part phi < 0 of the cut elements
+     *
+     * the element matrices are assembled from the reference matrices of the
+     * part phi < 0 into a and, in the transient case, m
+     */
+    void assembleCutElements( MaterialProperties const& mat, std::vector<typename mesh_t::element_type const*> const& cut, double c0 );
+    /**
+     * @brief matrix-free operator of the materials and Robin conditions
+     *
+     * builds mf_, its shells mfA_ and mfM_ and the low order preconditioner
+     * matrix mfP_, each instance has its own since the shells share the
+     * scratch vectors of mf_
+     */
+    void buildMatrixFreeOperator();
+    //! true if the matrix-free mode is preconditioned from the low order refined matrix
+    bool lowOrderPreconditioner() const;
+    /**
+     * @brief steady case: one solve of the diffusion and Robin terms and one export
+     *
+     * the operator is flagged symmetric positive definite and solved by
+     * default with CG and GAMG. With /Solver/laplacian/symmetric_storage
+     * it is converted in place to the upper triangular SBAIJ format, about
+     * half the memory, and preconditioned by default with ICC in serial and
+     * Jacobi in parallel, see /Solver/laplacian/pc-type
+     */
+    void steadySolve();
+    bool symmetricStorage() const;
+    //! log the solver statistics of the time loop
+    void reportSolverStats() const;
+    /**
+     * @brief operator of a time step when it is not frozen
+     *
+     * at_ is a_, the time invariant terms, plus the terms of the time
+     * dependent materials and Robin coefficients evaluated at @p t
+     */
+    void assembleTimeDependentOperator( double t );
+    //! communicator the timings are aggregated on, the one of the space
+    MPI_Comm timingsComm() const
     {
-        specs_ = l.specs_;
-        mesh_ = l.mesh_;
-        Xh_ = l.Xh_;
-        u_ = l.u_;
-        v_ = l.v_;
-        a_ = l.a_;
-        at_ = l.at_;
-        l_ = l.l_;
-        lt_ = l.lt_;
-        bdf_ = l.bdf_;
-        e_ = exporter( _mesh = mesh_ );
-        meas_ = l.meas_;
+        if ( !Xh_ )
+            throw std::logic_error( "laplacian: no space to aggregate the timings on, call initialize() or run() first" );
+        return Xh_->worldComm();
     }
-    return *this;
-}
-
-
-// Initialization
-template <int Dim, int Order>
-void Laplacian<Dim, Order>::initialize()
-{
-    // Load mesh and initialize Xh, a, l, etc.
-    mesh_ = loadMesh( _mesh = new mesh_t, _filename = specs_["/Meshes/laplacian/Import/filename"_json_pointer].get<std::string>() );
-    // define Xh on a marked region
-    if ( specs_["/Spaces/laplacian/Domain"_json_pointer].contains("marker") )
-        Xh_ = Pch<Order>(mesh_, markedelements(mesh_, specs_["/Spaces/laplacian/Domain/marker"_json_pointer].get<std::vector<std::string>>()));
-    // define Xh via a levelset phi where phi < 0 defines the Domain and phi = 0 the boundary
-    else if (specs_["/Spaces/laplacian/Domain"_json_pointer].contains("levelset"))
-        Xh_ = Pch<Order>(mesh_, elements(mesh_, expr(specs_["/Spaces/laplacian/Domain/levelset"_json_pointer].get<std::string>())));
-    // define Xh on the whole mesh
-    else
-        Xh_ = Pch<Order>(mesh_);
-
-    u_ = Xh_->element();
-    v_ = Xh_->element();
-
-    a_ = form2( _test = Xh_, _trial = Xh_ );
-    at_ = form2( _test = Xh_, _trial = Xh_ );
-    l_ = form1( _test = Xh_ );
-    lt_ = form1( _test = Xh_ );
-
-    bool steady = get_value(specs_, "/TimeStepping/laplacian/steady", true);
-    int time_order = get_value(specs_, "/TimeStepping/laplacian/order", 2);
-    double initial_time = get_value(specs_, "/TimeStepping/laplacian/start", 0.0);
-    double final_time = get_value(specs_, "/TimeStepping/laplacian/end", 1.0);
-    double time_step = get_value(specs_, "/TimeStepping/laplacian/step", 0.1);
-    bdf_ = Feel::bdf( _space = Xh_, _steady=steady, _initial_time=initial_time, _final_time=final_time, _time_step=time_step, _order=time_order );
-
-    bdf_->start();
-    if ( steady )
-        bdf_->setSteady();
-
-    bdf_->initialize( u_ );
-
-    if ( steady )
-        std::cout << "\n***** Compute Steady state *****" << std::endl;
-    else
-    {
-        std::cout << "\n***** Compute Transient state *****" << std::endl;
-        std::cout << "The step is  " << bdf_->timeStep() << "\n"
-                  << "The initial time is " << bdf_->timeInitial() << "\n"
-                  << "The final time is " << bdf_->timeFinal() << "\n"
-                  << "BDF order :  " << bdf_->timeOrder() << "\n" << std::endl
-                  << "BDF coeff :  " << bdf_->polyDerivCoefficient( 0 ) << "\n" << std::endl;
-    }
-
-    a_.zero();
-    at_.zero();
-    l_.zero();
-    lt_.zero();
-
-    e_ = Feel::exporter(_mesh = mesh_);
-}
-
-// Process materials
-template <int Dim, int Order>
-void Laplacian<Dim, Order>::processMaterials()
-{
-    for ( auto [key, material] : specs_["/Models/laplacian/Materials"_json_pointer].items() )
-    {
-        LOG( INFO ) << fmt::format( "Material {} found", material.dump() );
-        std::string mat = fmt::format( "/Materials/{}/k", material.get<std::string>() );
-        auto k = specs_[nl::json::json_pointer( mat )].get<std::string>();
-        std::string matRho = fmt::format( "/Materials/{}/rho", material.get<std::string>() );
-        auto Rho = specs_[nl::json::json_pointer( matRho )].get<std::string>();
-        std::string matCp = fmt::format( "/Materials/{}/Cp", material.get<std::string>() );
-        auto Cp = specs_[nl::json::json_pointer( matCp )].get<std::string>();
-
-        a_ += integrate( _range = markedelements( support( Xh_ ), material.get<std::string>() ),
-                _expr = bdf_->polyDerivCoefficient( 0 ) * expr( Rho ) * expr( Cp ) * idt( u_ ) * id( v_ ) + expr( k ) * gradt( u_ ) * trans( grad( v_ ) ) );
-    }
-}
-
-// Process boundary conditions
-template <int Dim, int Order>
-void Laplacian<Dim, Order>::processBoundaryConditions()
-{
-    // BC Neumann
-    if ( specs_["/BoundaryConditions/laplacian"_json_pointer].contains( "flux" ) )
-    {
-        for ( auto& [bc, value] : specs_["/BoundaryConditions/laplacian/flux"_json_pointer].items() )
-        {
-            LOG( INFO ) << fmt::format( "flux {}: {}", bc, value.dump() );
-            auto flux = value["expr"].get<std::string>();
-
-            l_ += integrate( _range = markedfaces( support( Xh_ ), bc ),
-                    _expr = expr( flux ) * id( v_ ) );
-        }
-    }
-
-    // BC Robin
-    if ( specs_["/BoundaryConditions/laplacian"_json_pointer].contains( "convective_laplacian_flux" ) )
+    //! add the time derivative term of @p bdf to the right hand side @p rhs
+    void addTimeDerivative( Bdf<space_t>& bdf, Vec rhs );
+    //! @return a key identifying the operator of @p specs, the right hand side data are ignored
+    static std::string operatorKey( nl::json specs );
+
+    //! write a snapshot of @p u at time @p t unless it is already exported
+    void exportFields( double t, element_t const& u ) const;
+    //! export the final state if required and wait for the pending writes
+    void finishExport( double t ) const;
+
+    /**
+     * @brief measures of the mesh and linear functionals of the postprocessing
+     *
+     * the integrals of u and of its normal flux over the mesh and its markers are
+     * assembled once as vectors q such that the measure is q.u
+     */
+    struct PostProcess
     {
-        for ( auto& [bc, value] : specs_["/BoundaryConditions/laplacian/convective_laplacian_flux"_json_pointer].items() )
+        struct Functional
         {
-            LOG( INFO ) << fmt::format( "convective_laplacian_flux {}: {}", bc, value.dump() );
-            auto h = value["h"].get<std::string>();
-            auto Text = value["Text"].get<std::string>();
-
-            a_ += integrate( _range = markedfaces( support( Xh_ ), bc ),
-                    _expr = expr( h ) * id( v_ ) * idt( u_ ) );
-            l_ += integrate( _range = markedfaces( support( Xh_ ), bc ),
-                    _expr = expr( h ) * expr( Text ) * id( v_ ) );
-        }
-    }
-}
-
-// Run method (main method to run Laplacian process)
-template <int Dim, int Order>
-void Laplacian<Dim, Order>::run()
-{
-    initialize();
-    processMaterials();
-    processBoundaryConditions();
-    timeLoop();
-    exportResults();
-}
-
-// Time loop
-template <int Dim, int Order>
-void Laplacian<Dim, Order>::timeLoop()
-{
-    // time loop
-    for ( bdf_->start(); bdf_->isFinished()==false; bdf_->next(u_) )
+            //! measure column and mean column if any
+            std::string column, meanColumn;
+            //! measure of the range to compute the mean
+            double measure;
+            vector_ptrtype q;
+        };
+        mesh_t const* mesh = nullptr;
+        //! the functionals are vectors of the space, which a levelset move changes on the same mesh
+        std::weak_ptr<space_t> space;
+        double measure = 0;
+        std::map<std::string, double> measures;
+        std::vector<Functional> functionals;
+        std::vector<Vec> vecs;
+        vector_ptr_t u;
+    };
+    void buildPostProcess() const;
+    //! @return @p f, @throw std::logic_error in matrix-free mode
+    form2_type const& assembled( form2_type const& f ) const
     {
-        at_ = a_;
-        lt_ = l_;
-
-        for ( auto [key, material] : specs_["/Models/laplacian/Materials"_json_pointer].items() )
-        {
-            std::string matRho = fmt::format( "/Materials/{}/rho", material.get<std::string>() );
-            std::string matCp = fmt::format( "/Materials/{}/Cp", material.get<std::string>() );
-            auto Rho = specs_[nl::json::json_pointer( matRho )].get<std::string>();
-            auto Cp = specs_[nl::json::json_pointer( matCp )].get<std::string>();
-
-            lt_ += integrate( _range = markedelements( support( Xh_ ), material.get<std::string>() ),
-                    _expr = expr( Rho ) * expr( Cp ) * idv( bdf_->polyDeriv() ) * id( v_ ) );
-        }
-
-        at_.solve( _rhs = lt_, _solution = u_ );
-
-        this->exportResults();
+        if ( matrixFree_ )
+            throw std::logic_error( "laplacian: the forms have no matrix in matrix-free mode" );
+        return f;
     }
-}
 
-// Export results
-template <int Dim, int Order>
-nl::json Laplacian<Dim, Order>::exportResults( double t, element_t const& u ) const
-{
-    e_->step(t)->addRegions();
-    e_->step(t)->add("u", u);
-    e_->save();
-
-    auto totalQuantity = integrate(_range=elements(mesh_), _expr=idv(u)).evaluate()(0,0);
-    auto totalFlux = integrate(_range=boundaryfaces(mesh_), _expr=gradv(u)*N()).evaluate()(0,0);
-    double meas=measure(_range=elements(mesh_), _expr=cst(1.0));
-    meas_["time"].push_back(t);
-    meas_["totalQuantity"].push_back(totalQuantity);
-    meas_["totalFlux"].push_back(totalFlux);
-    meas_["mean"].push_back(totalQuantity/meas);
-    meas_["min"].push_back(u.min());
-    meas_["max"].push_back(u.max());
-    for( auto [key,values] : mesh_->markerNames())
+    int id_ = nextInstanceId();
+    nl::json specs_;
+    std::shared_ptr<mesh_t> mesh_;
+    space_ptr_t Xh_;
+    std::shared_ptr<levelset_type> levelset_;
+    element_t u_, v_;
+    form2_type a_, at_, m_;
+    form1_type l_, lt_;
+    bdf_ptrtype bdf_;
+    bool steady_ = false;
+    TimeStepController adaptive_;
+    double time_ = 0;
+    // number of the time step of u, the last step and the states read from a checkpoint
+    int step_ = 0;
+    double restartDt_ = 0;
+    std::vector<std::vector<double>> restartStates_;
+    struct TransferredState
     {
-        if ( values[1] == Dim )
-        {
-            double meas=measure(_range=markedelements(mesh_,key), _expr=cst(1.0));
-            auto quantity = integrate(_range=markedelements(mesh_,key), _expr=idv(u)).evaluate()(0,0);
-            meas_[fmt::format("quantity_{}",key)].push_back(quantity);
-            meas_[fmt::format("mean_{}",key)].push_back(quantity/meas);
-        }
-        else if ( values[1] == Dim-1 )
-        {
-            double meas=measure(_range=markedfaces(mesh_,key), _expr=cst(1.0));
-            auto quantity = integrate(_range=markedfaces(mesh_,key), _expr=idv(u)).evaluate()(0,0);
-            meas_[fmt::format("quantity_{}",key)].push_back(quantity);
-            meas_[fmt::format("mean_{}",key)].push_back(quantity/meas);
-            auto flux = integrate(_range=markedfaces(mesh_,key), _expr=gradv(u)*N()).evaluate()(0,0);
-            meas_[fmt::format("flux_{}",key)].push_back(flux);
-        }
-
-    }
-    return meas_;
-}
-template <int Dim, int Order>
-void Laplacian<Dim, Order>::writeResultsToFile(const std::string& filename) const
-{
-    std::ofstream file(filename);
-    if (file.is_open()) {
-        file << meas_.dump(4);  // Indent of 4 spaces for readability
-        file.close();
-    } else {
-        std::cerr << "Unable to open file: " << filename << std::endl;
-    }
-}
-
-// Summary method
-template <int Dim, int Order>
-void Laplacian<Dim, Order>::summary(/*arguments*/) {
-    /* ... summary code ... */
-}
+        double time;
+        int step;
+        std::vector<element_t> states;
+    };
+    std::optional<TransferredState> transfer_;
+    mutable exporter_ptrtype e_;
+    mutable MeasuresStore meas_;
+    std::vector<MaterialProperties> materials_;
+    bool frozen_ = false;
+    // true if the rhs time derivative term is computed with m_
+    bool massRhs_ = false;
+    std::shared_ptr<LinearSolver> solver_;
+    vector_ptr_t x_, w_;
+    // space, Krylov method and preconditioner of solver_, x_ and w_
+    std::weak_ptr<space_t> solverSpace_;
+    std::pair<std::string, std::string> solverTypes_;
+    // matrix-free operator and its shell matrices for the operator and the mass
+    bool matrixFree_ = false;
+    std::shared_ptr<MatrixFreeOperator<space_t>> mf_;
+    Mat mfA_ = nullptr, mfM_ = nullptr, mfP_ = nullptr;
+    int assemblyThreads_ = 0;
+    ExportPolicy exportPolicy_;
+    mutable std::shared_ptr<AsyncExporter<mesh_t, element_t>> writer_;
+    mutable int exportStep_ = 0;
+    mutable double lastExportTime_ = -std::numeric_limits<double>::infinity();
+    mutable std::shared_ptr<PostProcess> post_;
+    mutable Timings timings_;
+};
 
-template <int Dim, int Order>
-typename Laplacian<Dim, Order>::form2_type
-Laplacian<Dim, Order>::assembleGradGrad( std::vector<std::string> const& markers, Eigen::MatrixXd const& coeffs )
-{
-    auto a = form2( _test = Xh_, _trial = Xh_ );
-    for( auto marker : markers )
-    {
-        LOG( INFO ) << fmt::format( "assemble grad.grad on marker {} with coeffs: {}", marker, coeffs );
-        a += integrate( _range = markedelements( support( Xh_ ), marker ),
-                        _expr = trans(constant<Dim,Dim>(coeffs) * trans(gradt( u_ ))) * trans(grad( v_ )) );
-    }
-    a.close();
-    return a;
-}
-template <int Dim, int Order>
-typename Laplacian<Dim, Order>::form2_type
-Laplacian<Dim, Order>::assembleMass( std::vector<std::string> const& markers, double coeff )
-{
-    auto a = form2( _test = Xh_, _trial = Xh_ );
-    for( auto marker : markers )
-    {
-        if ( mesh_->markerNames().at(marker)[1] == Dim )
-        {
-            LOG( INFO ) << fmt::format( "assemble mass on volume marker {} with coeff: {}", marker, coeff );
-            a += integrate( _range = markedelements( support( Xh_ ), marker ),
-                        _expr = coeff * idt( u_ ) * id( v_ ) );
-        }
-        else if ( mesh_->markerNames().at(marker)[1] == Dim-1 )
-        {
-            LOG( INFO ) << fmt::format( "assemble mass on face marker {} with coeff: {}", marker, coeff );
-            a += integrate( _range = markedfaces( support( Xh_ ), marker ),
-                        _expr = coeff * idt( u_ ) * id( v_ ) );
-        }
-    }
-    a.close();
-    return a;
-}
-template <int Dim, int Order>
-typename Laplacian<Dim, Order>::form1_type
-Laplacian<Dim, Order>::assembleFlux( std::vector<std::string> const& markers, double coeff )
-{
-    auto l = form1( _test = Xh_ );
-    for( auto marker : markers )
-    {
-        if ( mesh_->markerNames().at(marker)[1] == Dim )
-        {
-            LOG( INFO ) << fmt::format( "assemble flux on volume marker {} with coeff: {}", marker, coeff );
-            l += integrate( _range = markedelements( support( Xh_ ), marker ),
-                            _expr = coeff * id( v_ ) );
-        }
-        else
-        {
-            LOG(INFO) << fmt::format("assemble flux on marker {} is a face marker with coeff: {}", marker, coeff);
-            l += integrate( _range = markedfaces( support( Xh_ ), marker ),
-                            _expr = coeff * id( v_ ) );
-        }
-    }
-    l.close();
-    v_.setConstant(1);
-    LOG(INFO) << fmt::format("flux l(1)={}",l(v_)) << std::endl;
-    return l;
-}
+//! explicit instantiations built in the laplacian library, see laplacian_impl.hpp
+extern template class Laplacian<2, 1>;
+extern template class Laplacian<2, 2>;
+extern template class Laplacian<2, 3>;
+extern template class Laplacian<3, 1>;
+extern template class Laplacian<3, 2>;
 
 } // namespace Feel
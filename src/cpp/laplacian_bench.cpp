@@ -0,0 +1,207 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief benchmark of the phases of the laplacian application
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-16
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#include <sys/resource.h>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include "laplacian.hpp"
+
+namespace Feel
+{
+//! peak resident set size of the process in bytes
+inline long peakRss()
+{
+    struct rusage r;
+    getrusage( RUSAGE_SELF, &r );
+    // kilobytes on linux
+    return r.ru_maxrss * 1024L;
+}
+
+/**
+ * @brief run one case and time its phases
+ *
+ * the phases are separated by barriers and their time is the maximum over
+ * the ranks. The mesh and the space are loaded again for each case, the field
+ * export is timed on one synchronous snapshot of the final state.
+ *
+ * @param specs specs of the case
+ * @param steady true for the steady case, false for the transient one
+ * @param steps number of time steps of the transient case, 0 keeps /TimeStepping/laplacian/end
+ */
+template <int Dim, int Order>
+nl::json benchLaplacian( nl::json specs, bool steady, int steps )
+{
+    using laplacian_t = Laplacian<Dim, Order>;
+    auto& ts = specs["TimeStepping"]["laplacian"];
+    ts["steady"] = steady;
+    if ( !steady && steps > 0 )
+        ts["end"] = ts.value( "start", 0.0 ) + steps * ts.value( "step", 0.1 );
+    specs["PostProcess"]["laplacian"]["Exports"] = { { "mode", "none" } };
+
+    laplacian_t::clearCache();
+    laplacian_t lap;
+    lap.setSpecs( specs );
+    lap.setExportPolicy( ExportPolicy( specs["PostProcess"]["laplacian"]["Exports"] ) );
+
+    auto const& wc = Environment::worldComm();
+    nl::json times;
+    auto phase = [&]( std::string const& name, auto&& f ) {
+        wc.barrier();
+        auto t0 = std::chrono::steady_clock::now();
+        f();
+        wc.barrier();
+        double t = std::chrono::duration<double>( std::chrono::steady_clock::now() - t0 ).count();
+        times[name] = mpi::all_reduce( wc, t, mpi::maximum<double>() );
+    };
+    phase( "mesh", [&] { lap.initializeMesh(); } );
+    phase( "space", [&] { lap.initializeSpace(); } );
+    phase( "assembly", [&] {
+        lap.initializeModel();
+        lap.processMaterials();
+        lap.processBoundaryConditions();
+    } );
+    phase( "time_loop", [&] { lap.timeLoop(); } );
+    phase( "export", [&] { AsyncExporter<typename laplacian_t::mesh_t, typename laplacian_t::element_t>( lap.exporter(), false, 1 ).push( lap.time(), lap.u() ); } );
+
+    // the solver setups and solves are part of the time loop
+    auto stats = lap.solverStats();
+    double setup = mpi::all_reduce( wc, stats.value( "setup_time", 0. ), mpi::maximum<double>() );
+    double solve = mpi::all_reduce( wc, stats.value( "solve_time", 0. ), mpi::maximum<double>() );
+    times["solver_setup"] = setup;
+    times["solve"] = solve;
+    times["time_loop_other"] = std::max( 0., times["time_loop"].get<double>() - setup - solve );
+
+    long rss = peakRss();
+    double ndof = lap.Xh()->nDof();
+    int nsolves = stats.value( "solves", 0 );
+    nl::json r;
+    r["dim"] = Dim;
+    r["order"] = Order;
+    r["steady"] = steady;
+    r["nprocs"] = wc.size();
+    r["nelements"] = lap.mesh()->numGlobalElements();
+    r["ndofs"] = ndof;
+    r["solver"] = stats;
+    r["times"] = times;
+    r["timings"] = lap.timings();
+    r["assembly_dofs_per_s"] = ndof / std::max( times["assembly"].get<double>(), 1e-12 );
+    r["solve_dofs_per_s"] = ndof * nsolves / std::max( setup + solve, 1e-12 );
+    r["peak_rss_max"] = mpi::all_reduce( wc, rss, mpi::maximum<long>() );
+    r["peak_rss_sum"] = mpi::all_reduce( wc, rss, std::plus<long>() );
+    return r;
+}
+
+//! instantiations available at runtime, see laplacian_inst.cpp.in
+inline std::map<std::pair<int, int>, nl::json ( * )( nl::json, bool, int )> const& benchRunners()
+{
+    static const std::map<std::pair<int, int>, nl::json ( * )( nl::json, bool, int )> runners = {
+        { { 2, 1 }, &benchLaplacian<2, 1> },
+        { { 2, 2 }, &benchLaplacian<2, 2> },
+        { { 2, 3 }, &benchLaplacian<2, 3> },
+        { { 3, 1 }, &benchLaplacian<3, 1> },
+        { { 3, 2 }, &benchLaplacian<3, 2> } };
+    return runners;
+}
+
+inline std::vector<std::string> splitList( std::string const& s )
+{
+    std::vector<std::string> items;
+    std::istringstream is( s );
+    for ( std::string item; std::getline( is, item, ',' ); )
+        if ( !item.empty() )
+            items.push_back( item );
+    return items;
+}
+} // namespace Feel
+
+int main(int argc, char** argv)
+{
+    using namespace Feel;
+    // before the environment, for the asynchronous exports of the serial runs
+    MPIThreadMultiple mpi( argc, argv );
+    auto desc = makeOptions();
+    po::options_description options( "laplacian benchmark options" );
+    options.add_options()
+        ( "bench.orders", po::value<std::string>()->default_value( "1,2" ), "comma separated list of polynomial orders" )
+        ( "bench.modes", po::value<std::string>()->default_value( "steady,transient" ), "comma separated list of cases among steady and transient" )
+        ( "bench.steps", po::value<int>()->default_value( 10 ), "number of time steps of the transient cases, 0 keeps the specs" )
+        ( "bench.repeat", po::value<int>()->default_value( 1 ), "number of runs of each case" )
+        ( "bench.output", po::value<std::string>()->default_value( "" ), "json file of the results, appended to if it exists" );
+    desc.add( options );
+    try
+    {
+        Environment env(_argc = argc, _argv = argv,
+                        _desc = desc,
+                        _about = about(_name = "laplacian_bench",
+                                       _author = "Feel++ Consortium",
+                                       _email = "feelpp@cemosis.fr"));
+        auto jsonfile = removeComments(readFromFile(Environment::expand(soption("specs"))));
+        std::istringstream istr(jsonfile);
+        json specs = json::parse(istr);
+
+        int dim = ioption( "dim" ) > 0 ? ioption( "dim" ) : get_value( specs, "/Spaces/laplacian/dim", FEELPP_DIM );
+        nl::json results = nl::json::array();
+        for ( auto const& o : splitList( soption( "bench.orders" ) ) )
+        {
+            int order = std::stoi( o );
+            auto runner = benchRunners().find( { dim, order } );
+            if ( runner == benchRunners().end() )
+                throw std::invalid_argument( fmt::format( "laplacian in dimension {} with order {} is not available", dim, order ) );
+            for ( auto const& mode : splitList( soption( "bench.modes" ) ) )
+            {
+                if ( mode != "steady" && mode != "transient" )
+                    throw std::invalid_argument( fmt::format( "unknown benchmark case {}", mode ) );
+                for ( int r = 0; r < ioption( "bench.repeat" ); ++r )
+                {
+                    auto res = runner->second( specs, mode == "steady", ioption( "bench.steps" ) );
+                    res["geo_variables"] = soption( "gmsh.geo-variables-list" );
+                    res["repeat"] = r;
+                    if ( Environment::isMasterRank() )
+                        std::cout << res.dump() << std::endl;
+                    results.push_back( res );
+                }
+            }
+        }
+
+        if ( auto output = soption( "bench.output" ); !output.empty() && Environment::isMasterRank() )
+        {
+            // the results of several runs, e.g. at different numbers of ranks, are gathered in one file
+            nl::json all = nl::json::array();
+            if ( std::ifstream in( output ); in )
+                all = nl::json::parse( in );
+            for ( auto const& r : results )
+                all.push_back( r );
+            std::ofstream( output ) << all.dump( 2 );
+        }
+    }
+    catch (...)
+    {
+        handleExceptions();
+    }
+    return 0;
+}
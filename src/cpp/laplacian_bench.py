@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""Strong and weak scaling runs of the laplacian benchmark on the fin meshes.
+
+Each run of the benchmark application loads one fin mesh, given by the
+Nfins and h geo variables, and times the steady and transient cases of the
+requested orders at one number of MPI ranks. The results of all the runs
+are gathered in one json file, one record per case.
+
+Strong scaling keeps the mesh and increases the number of ranks:
+
+    laplacian_bench.py --app ./feelpp_project_laplacian_bench --np 1 2 4 --h 0.05 0.025
+
+Weak scaling multiplies the number of fins by the number of ranks:
+
+    laplacian_bench.py --app ./feelpp_project_laplacian_bench --np 1 2 4 --nfins 2 --weak
+"""
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+
+def finSpecs(filename, nfins):
+    """specs of the fin case with one material per fin"""
+    with open(filename) as f:
+        specs = json.load(f)
+    import_ = specs["Meshes"]["laplacian"]["Import"]
+    import_["filename"] = import_["filename"].replace("$cfgdir/..", os.path.dirname(os.path.abspath(filename)))
+    material = specs["Materials"]["Post"]
+    names = ["Post"] + [f"Fin_{i}" for i in range(1, nfins + 1)]
+    specs["Materials"] = {name: dict(specs["Materials"].get(name, material)) for name in names}
+    specs["Models"]["laplacian"]["Materials"] = names
+    return specs
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    p = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("--app", required=True, help="benchmark application")
+    p.add_argument("--config-file", default=os.path.join(here, "../cases/laplacian/fin/fin1/fin2d.cfg"))
+    p.add_argument("--specs", default=os.path.join(here, "../cases/laplacian/fin/fin2d.json"))
+    p.add_argument("--np", type=int, nargs="+", default=[1], help="numbers of MPI ranks")
+    p.add_argument("--nfins", type=int, nargs="+", default=[1, 4], help="numbers of fins")
+    p.add_argument("--h", type=float, nargs="+", default=[0.1, 0.05, 0.025], help="mesh sizes")
+    p.add_argument("--dim", type=int, default=2)
+    p.add_argument("--orders", default="1,2")
+    p.add_argument("--modes", default="steady,transient")
+    p.add_argument("--steps", type=int, default=10)
+    p.add_argument("--repeat", type=int, default=1)
+    p.add_argument("--weak", action="store_true", help="multiply the number of fins by the number of ranks")
+    p.add_argument("--mpiexec", default="mpiexec")
+    p.add_argument("--output", default="laplacian_bench.json")
+    args = p.parse_args()
+
+    results = []
+    for np in args.np:
+        for nfins in args.nfins:
+            for h in args.h:
+                n = nfins * np if args.weak else nfins
+                with tempfile.TemporaryDirectory() as tmp:
+                    out = os.path.join(tmp, "bench.json")
+                    specs = os.path.join(tmp, "specs.json")
+                    with open(specs, "w") as f:
+                        json.dump(finSpecs(args.specs, n), f)
+                    cmd = [args.mpiexec, "-np", str(np), args.app,
+                           "--config-file", args.config_file,
+                           "--specs", specs,
+                           "--dim", str(args.dim),
+                           f"--gmsh.geo-variables-list=Nfins={n}:h={h}:dim={args.dim}",
+                           "--bench.orders", args.orders,
+                           "--bench.modes", args.modes,
+                           "--bench.steps", str(args.steps),
+                           "--bench.repeat", str(args.repeat),
+                           "--bench.output", out,
+                           "--directory", os.path.join(tmp, "run")]
+                    print(" ".join(cmd), flush=True)
+                    subprocess.run(cmd, check=True)
+                    with open(out) as f:
+                        for r in json.load(f):
+                            r.update({"nfins": n, "h": h, "weak": args.weak})
+                            results.append(r)
+
+    with open(args.output, "w") as f:
+        json.dump(results, f, indent=2)
+    print(f"{len(results)} cases written to {args.output}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,1691 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief definitions of the members of Laplacian, included by the explicit instantiations
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2023-10-31
+//! @copyright 2023 Feel++ Consortium
+//! @copyright 2023 Université de Strasbourg
+//!
+#pragma once
+
+#include "laplacian.hpp"
+
+namespace Feel
+{
+// Constructor
+template <int Dim, int Order>
+Laplacian<Dim, Order>::Laplacian(nl::json const& specs) : specs_(specs)
+{
+    initialize();
+}
+template <int Dim, int Order>
+Laplacian<Dim, Order>::Laplacian( Laplacian const& l )
+    : specs_( l.specs_ ),
+      mesh_( l.mesh_ ),
+      Xh_( l.Xh_ ),
+      levelset_( l.levelset_ ? std::make_shared<levelset_type>( *l.levelset_ ) : nullptr ),
+      u_( l.u_ ),
+      v_( l.v_ ),
+      l_( form1( _test = Xh_ ) ),
+      lt_( form1( _test = Xh_ ) ),
+      bdf_( l.bdf_ ),
+      steady_( l.steady_ ),
+      adaptive_( l.adaptive_ ),
+      time_( l.time_ ),
+      meas_( l.meas_ ),
+      materials_( l.materials_ ),
+      frozen_( l.frozen_ ),
+      massRhs_( l.massRhs_ ),
+      matrixFree_( l.matrixFree_ ),
+      // the threaded assembly only reads the element data of mf_
+      mf_( l.matrixFree_ ? nullptr : l.mf_ ),
+      exportPolicy_( l.exportPolicy_ ),
+      post_( l.post_ )
+{
+    // the shells apply the operator with the scratch vectors of mf_, each
+    // copy builds its own operator
+    if ( l.matrixFree_ && l.mf_ )
+        buildMatrixFreeOperator();
+    // the forms have no matrix in matrix-free mode, the steady problem has
+    // no mass and time dependent operator
+    if ( !l.matrixFree_ )
+    {
+        a_ = form2( _test = Xh_, _trial = Xh_ );
+        a_ = l.a_;
+        if ( !l.steady_ )
+        {
+            at_ = form2( _test = Xh_, _trial = Xh_ );
+            at_ = l.at_;
+            m_ = form2( _test = Xh_, _trial = Xh_ );
+            m_ = l.m_;
+        }
+    }
+    l_ = l.l_;
+    lt_ = l.lt_;
+}
+
+template <int Dim, int Order>
+Laplacian<Dim, Order>::Laplacian( Laplacian&& l ) noexcept
+    : id_( l.id_ ),
+      specs_( std::move( l.specs_ ) ),
+      mesh_( std::move( l.mesh_ ) ),
+      Xh_( std::move( l.Xh_ ) ),
+      levelset_( std::move( l.levelset_ ) ),
+      u_( std::move( l.u_ ) ),
+      v_( std::move( l.v_ ) ),
+      a_( std::move( l.a_ ) ),
+      at_( std::move( l.at_ ) ),
+      m_( std::move( l.m_ ) ),
+      l_( std::move( l.l_ ) ),
+      lt_( std::move( l.lt_ ) ),
+      bdf_( std::move( l.bdf_ ) ),
+      steady_( l.steady_ ),
+      adaptive_( l.adaptive_ ),
+      time_( l.time_ ),
+      e_( std::move( l.e_ ) ),
+      meas_( std::move( l.meas_ ) ),
+      materials_( std::move( l.materials_ ) ),
+      frozen_( l.frozen_ ),
+      massRhs_( l.massRhs_ ),
+      solver_( std::move( l.solver_ ) ),
+      x_( std::move( l.x_ ) ),
+      w_( std::move( l.w_ ) ),
+      solverSpace_( std::move( l.solverSpace_ ) ),
+      solverTypes_( std::move( l.solverTypes_ ) ),
+      matrixFree_( l.matrixFree_ ),
+      mf_( std::move( l.mf_ ) ),
+      mfA_( l.mfA_ ),
+      mfM_( l.mfM_ ),
+      mfP_( l.mfP_ ),
+      exportPolicy_( l.exportPolicy_ ),
+      writer_( std::move( l.writer_ ) ),
+      exportStep_( l.exportStep_ ),
+      lastExportTime_( l.lastExportTime_ ),
+      post_( std::move( l.post_ ) )
+{
+    // Optionally, handle the moved-from state if necessary
+}
+template <int Dim, int Order>
+Laplacian<Dim, Order>&
+Laplacian<Dim, Order>::operator=( Laplacian const& l )
+{
+    if ( this != &l )
+    {
+        specs_ = l.specs_;
+        mesh_ = l.mesh_;
+        Xh_ = l.Xh_;
+        levelset_ = l.levelset_ ? std::make_shared<levelset_type>( *l.levelset_ ) : nullptr;
+        u_ = l.u_;
+        v_ = l.v_;
+        if ( !l.matrixFree_ )
+        {
+            a_ = l.a_;
+            if ( !l.steady_ )
+            {
+                at_ = l.at_;
+                m_ = l.m_;
+            }
+        }
+        l_ = l.l_;
+        lt_ = l.lt_;
+        bdf_ = l.bdf_;
+        steady_ = l.steady_;
+        adaptive_ = l.adaptive_;
+        time_ = l.time_;
+        e_.reset();
+        meas_ = l.meas_;
+        materials_ = l.materials_;
+        frozen_ = l.frozen_;
+        massRhs_ = l.massRhs_;
+        solver_.reset();
+        x_.reset();
+        w_.reset();
+        solverSpace_.reset();
+        matrixFree_ = l.matrixFree_;
+        mf_.reset();
+        mfA_ = mfM_ = mfP_ = nullptr;
+        if ( l.matrixFree_ && l.mf_ )
+            buildMatrixFreeOperator();
+        else
+            mf_ = l.mf_;
+        exportPolicy_ = l.exportPolicy_;
+        writer_.reset();
+        exportStep_ = 0;
+        lastExportTime_ = -std::numeric_limits<double>::infinity();
+        post_ = l.post_;
+    }
+    return *this;
+}
+
+
+// Initialization
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::initialize()
+{
+    timings_.clear();
+    if ( specs_.contains( "/PostProcess/laplacian/Timings/trace"_json_pointer ) )
+        timings_.setTrace( true );
+    auto timer = timings_.scope( "initialize" );
+    initializeMesh();
+    initializeSpace();
+    initializeModel();
+
+    e_.reset();
+    exportPolicy_ = ExportPolicy( get_value( specs_, "/PostProcess/laplacian/Exports", nl::json::object() ) );
+    meas_.clear();
+    // a run resumed from a checkpoint appends to the measures of the first run
+    meas_.setOutput( get_value( specs_, "/PostProcess/laplacian/Measures", nl::json::object() ), Xh_->worldComm().isMasterRank(), step_ > 0 );
+    writer_.reset();
+    exportStep_ = 0;
+    lastExportTime_ = -std::numeric_limits<double>::infinity();
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::initializeMesh()
+{
+    auto timer = timings_.scope( "initializeMesh" );
+    // the mesh is shared by all the instances with the same mesh import specs
+    auto const& import = specs_["/Meshes/laplacian/Import"_json_pointer];
+    auto key = meshCacheKey( import, Environment::numberOfProcessors() );
+    mesh_ = ObjectCache<mesh_t>::instance().get( key, [&]() { return loadMeshCached<mesh_t>( import, key ); } );
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::initializeSpace()
+{
+    auto timer = timings_.scope( "initializeSpace" );
+    // the space is shared by all the instances with the same mesh and domain specs
+    auto key = meshCacheKey( specs_["/Meshes/laplacian/Import"_json_pointer], Environment::numberOfProcessors() );
+    auto const& domain = specs_["/Spaces/laplacian/Domain"_json_pointer];
+    auto domainKey = domain.dump();
+    if ( domain.contains( "levelset" ) )
+    {
+        // the space depends on the active elements only, not on the levelset
+        if ( !levelset_ || levelset_->mesh() != mesh_ )
+            levelset_ = std::make_shared<levelset_type>( mesh_, get_value( specs_, "/Spaces/laplacian/Domain/band", 2 ) );
+        levelset_->update( domain["levelset"].get<std::string>() );
+        domainKey = "levelset|" + levelset_->activeKey();
+    }
+    else
+        levelset_.reset();
+    Xh_ = ObjectCache<space_t>::instance().get( key + "|" + domainKey, [&]() -> space_ptr_t {
+        // define Xh on a marked region
+        if ( domain.contains("marker") )
+            return Pch<Order>(mesh_, markedelements(mesh_, domain["marker"].get<std::vector<std::string>>()));
+        // define Xh via a levelset phi where phi < 0 defines the Domain and phi = 0 the boundary
+        else if ( domain.contains("levelset") )
+            return Pch<Order>(mesh_, levelset_->activeElements());
+        // define Xh on the whole mesh
+        else
+            return Pch<Order>(mesh_);
+    } );
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::initializeModel()
+{
+    auto timer = timings_.scope( "initializeModel" );
+    // u keeps its storage on the same space, the numpy views of uArray()
+    // stay valid across the runs
+    if ( u_.functionSpace() != Xh_ )
+    {
+        u_ = Xh_->element();
+        v_ = Xh_->element();
+    }
+    else
+        u_.zero();
+
+    initializeOperator();
+
+    bdf_ = steady_ ? nullptr : createBdf( "bdf" );
+    time_ = get_value( specs_, "/TimeStepping/laplacian/start", 0.0 );
+    adaptive_ = TimeStepController( get_value( specs_, "/TimeStepping/laplacian/adaptive", nl::json() ),
+                                    get_value( specs_, "/TimeStepping/laplacian/step", 0.1 ) );
+
+    // initial state: the initial conditions, then the last checkpoint if the
+    // run restarts, in the steady case it is the initial guess of the solver
+    applyInitialConditions();
+    step_ = 0;
+    restartDt_ = 0;
+    restartStates_.clear();
+    if ( !steady_ )
+        bdf_->initialize( u_ );
+    // a state transferred from another mesh takes precedence over the checkpoint
+    if ( transfer_ )
+        restoreTransferredState();
+    else if ( !steady_ )
+        restoreCheckpoint();
+
+    if ( steady_ )
+        std::cout << "\n***** Compute Steady state *****" << std::endl;
+    else
+    {
+        std::cout << "\n***** Compute Transient state *****" << std::endl;
+        std::cout << "The step is  " << bdf_->timeStep() << "\n"
+                  << "The initial time is " << bdf_->timeInitial() << "\n"
+                  << "The final time is " << bdf_->timeFinal() << "\n"
+                  << "BDF order :  " << bdf_->timeOrder() << "\n" << std::endl
+                  << "BDF coeff :  " << bdf_->polyDerivCoefficient( 0 ) << "\n" << std::endl;
+    }
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::initializeOperator()
+{
+    // in matrix-free mode the sparse matrices of the operator and the mass
+    // are never allocated, the preconditioner is built from the sparser P1
+    // matrix on the low order refined elements, or is Jacobi
+    matrixFree_ = get_value( specs_, "/Solver/laplacian/matrix_free", false );
+    assemblyThreads_ = matrixFree_ ? 0 : get_value( specs_, "/Solver/laplacian/assembly_threads", 0 );
+#if defined( _OPENMP )
+    if ( assemblyThreads_ < 0 )
+        assemblyThreads_ = omp_get_max_threads();
+#else
+    assemblyThreads_ = assemblyThreads_ != 0 ? 1 : 0;
+#endif
+    mf_.reset();
+    mfA_ = mfM_ = mfP_ = nullptr;
+    // the steady problem has no time derivative: neither a time scheme nor
+    // the mass and time dependent operator matrices are built
+    steady_ = get_value( specs_, "/TimeStepping/laplacian/steady", true );
+    if ( !matrixFree_ )
+    {
+        a_ = form2( _test = Xh_, _trial = Xh_ );
+        if ( !steady_ )
+        {
+            at_ = form2( _test = Xh_, _trial = Xh_ );
+            m_ = form2( _test = Xh_, _trial = Xh_ );
+        }
+    }
+    l_ = form1( _test = Xh_ );
+    lt_ = form1( _test = Xh_ );
+
+    // the solver and its vectors are sized on the space, they are built
+    // again on a new space, e.g. after a remeshing, or when the model needs
+    // another method, e.g. no multigrid on the shell of the matrix-free mode
+    if ( solverSpace_.lock() != Xh_ || solverTypes() != solverTypes_ )
+    {
+        solver_.reset();
+        x_.reset();
+        w_.reset();
+    }
+    // the matrix of a new operator may reuse the address of the previous one
+    else if ( solver_ )
+        solver_->operatorChanged();
+
+    // parse the material properties once, the assembly never goes back to
+    // the json specs or the expression parser
+    materials_ = materialProperties( specs_, "laplacian" );
+
+    // the operator can be frozen explicitly in the specs, otherwise it is
+    // frozen as soon as none of its coefficients depend on time
+    frozen_ = matrixFree_ || get_value( specs_, "/TimeStepping/laplacian/frozen_operator", isOperatorTimeInvariant() );
+    LOG( INFO ) << fmt::format( "operator frozen: {}", frozen_ );
+
+    if ( !matrixFree_ )
+    {
+        a_.zero();
+        if ( !steady_ )
+        {
+            at_.zero();
+            m_.zero();
+        }
+    }
+    l_.zero();
+    lt_.zero();
+}
+
+template <int Dim, int Order>
+typename Laplacian<Dim, Order>::bdf_ptrtype
+Laplacian<Dim, Order>::createBdf( std::string const& name ) const
+{
+    bool steady = get_value(specs_, "/TimeStepping/laplacian/steady", true);
+    int time_order = get_value(specs_, "/TimeStepping/laplacian/order", 2);
+    double initial_time = get_value(specs_, "/TimeStepping/laplacian/start", 0.0);
+    double final_time = get_value(specs_, "/TimeStepping/laplacian/end", 1.0);
+    double time_step = get_value(specs_, "/TimeStepping/laplacian/step", 0.1);
+    auto b = Feel::bdf( _space = Xh_, _name = name, _steady=steady, _initial_time=initial_time, _final_time=final_time, _time_step=time_step, _order=time_order );
+
+    b->start();
+    if ( steady )
+        b->setSteady();
+    return b;
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::applyInitialConditions()
+{
+    auto ic = get_value( specs_, "/InitialConditions/laplacian/temperature", nl::json::object() );
+    auto markers = []( nl::json const& j ) {
+        return j.is_string() ? std::vector<std::string>{ j.get<std::string>() } : j.get<std::vector<std::string>>();
+    };
+    if ( ic.contains( "Expression" ) )
+    {
+        for ( auto const& [name, value] : ic["Expression"].items() )
+        {
+            LOG( INFO ) << fmt::format( "initial condition {}: {}", name, value.dump() );
+            auto e = parseExpr( value["expr"].get<std::string>() );
+            e.setParameterValues( { { "t", time_ } } );
+            if ( value.contains( "markers" ) )
+                u_.on( _range = markedelements( support( Xh_ ), markers( value["markers"] ) ), _expr = e );
+            else
+                u_.on( _range = elements( support( Xh_ ) ), _expr = e );
+        }
+    }
+    // final state of a previous run with the same mesh and number of ranks
+    if ( ic.contains( "File" ) )
+    {
+        auto dir = Environment::expand( ic["File"]["checkpoint"].get<std::string>() );
+        std::vector<std::vector<double>> fields;
+        auto meta = CheckpointStore( dir, Xh_->worldComm() ).read( u_.map().nLocalDofWithGhost(), fields );
+        setLocalValues( u_, fields.front() );
+        LOG( INFO ) << fmt::format( "initial condition from the state at t={} of {}", meta["time"].get<double>(), dir );
+    }
+}
+
+template <int Dim, int Order>
+CheckpointStore Laplacian<Dim, Order>::checkpointStore() const
+{
+    auto c = get_value( specs_, "/TimeStepping/laplacian/checkpoint", nl::json::object() );
+    return CheckpointStore( Environment::expand( c.value( "directory", std::string( "checkpoints" ) ) ), Xh_->worldComm(), c.value( "keep", 2 ) );
+}
+
+template <int Dim, int Order>
+bool Laplacian<Dim, Order>::checkpointDue( bool final ) const
+{
+    int every = get_value( specs_, "/TimeStepping/laplacian/checkpoint/every", 0 );
+    if ( every <= 0 || step_ == 0 )
+        return false;
+    // the final state is written unless the last step was already
+    return final ? step_ % every != 0 : step_ % every == 0;
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::writeCheckpoint( std::vector<element_t const*> const& states, double dt ) const
+{
+    auto timer = timings_.scope( "checkpoint" );
+    std::vector<std::vector<double>> fields;
+    for ( auto const* s : states )
+        fields.push_back( localValues( *s ) );
+    nl::json meta = { { "time", time_ }, { "dt", dt }, { "order", bdf_->timeOrder() } };
+    checkpointStore().write( step_, meta, fields );
+    LOG( INFO ) << fmt::format( "checkpoint at step {}, t={}", step_, time_ );
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::restoreCheckpoint()
+{
+    auto r = get_value( specs_, "/TimeStepping/laplacian/restart", nl::json( false ) );
+    if ( r.is_boolean() && !r.get<bool>() )
+        return;
+    auto store = r.is_string() ? CheckpointStore( Environment::expand( r.get<std::string>() ), Xh_->worldComm() ) : checkpointStore();
+    if ( !store.exists() )
+    {
+        // the same job script starts and resumes the run
+        if ( r.is_string() )
+            throw std::runtime_error( fmt::format( "no checkpoint in {}", store.directory() ) );
+        LOG( INFO ) << fmt::format( "no checkpoint in {}, start from the initial conditions", store.directory() );
+        return;
+    }
+    auto meta = store.read( u_.map().nLocalDofWithGhost(), restartStates_ );
+    if ( meta.value( "order", bdf_->timeOrder() ) != bdf_->timeOrder() )
+        LOG( WARNING ) << fmt::format( "checkpoint of a scheme of order {}, restart with order {}", meta["order"].get<int>(), bdf_->timeOrder() );
+    restoreState( meta );
+    if ( Environment::isMasterRank() )
+        std::cout << fmt::format( "[laplacian] restart from {} at step {}, t={}", store.directory(), step_, time_ ) << std::endl;
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::restoreState( nl::json const& meta )
+{
+    time_ = meta["time"].get<double>();
+    step_ = meta["step"].get<int>();
+    restartDt_ = meta.value( "dt", 0. );
+    // u and the history of the scheme, the missing states are the oldest one
+    setLocalValues( u_, restartStates_.front() );
+    if ( !bdf_ )
+        return;
+    auto const& unknowns = bdf_->unknowns();
+    for ( std::size_t i = 0; i < unknowns.size(); ++i )
+        setLocalValues( *unknowns[i], restartStates_[std::min( i, restartStates_.size() - 1 )] );
+    bdf_->setTimeInitial( time_ );
+}
+
+template <int Dim, int Order>
+std::vector<typename Laplacian<Dim, Order>::element_t> Laplacian<Dim, Order>::states() const
+{
+    std::vector<element_t> s{ u_ };
+    if ( bdf_ )
+    {
+        // the first unknown of the scheme is u after a step
+        auto const& unknowns = bdf_->unknowns();
+        for ( std::size_t i = 1; i < unknowns.size(); ++i )
+            s.push_back( *unknowns[i] );
+    }
+    return s;
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::setTransferredState( double t, int step, std::vector<element_t> const& states )
+{
+    if ( states.empty() )
+        throw std::invalid_argument( "transferred state: no state" );
+    transfer_ = TransferredState{ t, step, states };
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::restoreTransferredState()
+{
+    auto timer = timings_.scope( "transferState" );
+    restartStates_.clear();
+    for ( auto const& s : transfer_->states )
+    {
+        if ( s.functionSpace() == Xh_ )
+        {
+            restartStates_.push_back( localValues( s ) );
+            continue;
+        }
+        auto w = Xh_->element();
+        auto op = opInterpolation( _domainSpace = s.functionSpace(), _imageSpace = Xh_, _range = elements( support( Xh_ ) ) );
+        op->apply( s, w );
+        restartStates_.push_back( localValues( w ) );
+    }
+    restoreState( { { "time", transfer_->time }, { "step", transfer_->step } } );
+    transfer_.reset();
+    LOG( INFO ) << fmt::format( "state of step {} at t={} transferred on {} dofs", step_, time_, Xh_->nDof() );
+}
+
+template <int Dim, int Order>
+std::vector<double> Laplacian<Dim, Order>::localValues( element_t const& u )
+{
+    std::vector<double> v( u.map().nLocalDofWithGhost() );
+    for ( std::size_t i = 0; i < v.size(); ++i )
+        v[i] = u( i );
+    return v;
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::setLocalValues( element_t& u, std::vector<double> const& v )
+{
+    for ( std::size_t i = 0; i < v.size(); ++i )
+        u( i ) = v[i];
+}
+
+// Process materials
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::processMaterials()
+{
+    auto timer = timings_.scope( "processMaterials" );
+    // the time derivative rhs is a product with the weighted mass matrix as
+    // long as rho and Cp do not depend on time
+    massRhs_ = true;
+    double c0 = steady_ ? 0. : bdf_->polyDerivCoefficient( 0 );
+    if ( matrixFree_ )
+    {
+        if ( levelset_ )
+            LOG( WARNING ) << "matrix-free operator: the cut elements are integrated whole";
+        buildMatrixFreeOperator();
+        return;
+    }
+    // hybrid mode: the constant materials are assembled by threads from the
+    // reference element matrices, the others by integrate
+    if ( assemblyThreads_ > 0 )
+        mf_ = std::make_shared<MatrixFreeOperator<space_t>>( Xh_, Order );
+    bool cutQuadrature = levelset_ && get_value( specs_, "/Spaces/laplacian/Domain/cut_quadrature", true );
+    for ( auto const& mat : materials_ )
+    {
+        LOG( INFO ) << fmt::format( "Material {} found", mat.name );
+        auto range = markedelements( support( Xh_ ), mat.name );
+        if ( cutQuadrature && mat.isConstant() )
+        {
+            typename levelset_type::range_type inside( mesh_ );
+            std::vector<typename mesh_t::element_type const*> cut;
+            levelset_->split( range, inside, cut );
+            assembleCutElements( mat, cut, c0 );
+            range = inside;
+        }
+        else if ( cutQuadrature )
+            LOG( WARNING ) << fmt::format( "material {}: the cut elements are integrated whole, the properties are not constant", mat.name );
+        if ( mat.isConstant() && assemblyThreads_ > 0 )
+        {
+            mf_->addElements( range, mat.k.value(), mat.rho.value() * mat.Cp.value() );
+            continue;
+        }
+        if ( steady_ )
+        {
+            // only the diffusion term
+            withCoefficient( mat.k, [&]( auto const& k ) {
+                a_ += integrate( _range = range, _expr = k * gradt( u_ ) * trans( grad( v_ ) ) );
+            } );
+            continue;
+        }
+        // a time dependent operator keeps in a_ its time invariant part, the
+        // terms of this material are assembled at each step
+        if ( !frozen_ && mat.isTimeDependent() )
+        {
+            if ( mat.isMassTimeDependent() )
+                massRhs_ = false;
+            else
+                withProduct( mat.rho, mat.Cp, [&]( auto const& rhoCp ) {
+                    m_ += integrate( _range = range, _expr = rhoCp * idt( u_ ) * id( v_ ) );
+                } );
+            continue;
+        }
+        if ( mat.isConstant() )
+        {
+            double rhoCp = mat.rho.value() * mat.Cp.value();
+            a_ += integrate( _range = range,
+                    _expr = cst( c0 * rhoCp ) * idt( u_ ) * id( v_ ) + cst( mat.k.value() ) * gradt( u_ ) * trans( grad( v_ ) ) );
+            m_ += integrate( _range = range, _expr = cst( rhoCp ) * idt( u_ ) * id( v_ ) );
+            continue;
+        }
+        // the constant properties enter as cst(), only the others are symbolic
+        withCoefficient( mat.k, [&]( auto const& k ) {
+            withProduct( mat.rho, mat.Cp, [&]( auto const& rhoCp ) {
+                a_ += integrate( _range = range,
+                        _expr = c0 * rhoCp * idt( u_ ) * id( v_ ) + k * gradt( u_ ) * trans( grad( v_ ) ) );
+                if ( !mat.isMassTimeDependent() )
+                    m_ += integrate( _range = range, _expr = rhoCp * idt( u_ ) * id( v_ ) );
+            } );
+        } );
+        if ( mat.isMassTimeDependent() )
+            massRhs_ = false;
+    }
+    if ( assemblyThreads_ > 0 && mf_->nElements() > 0 )
+    {
+        mf_->assemble( toPETSc( a_.matrixPtr() )->mat(), 1, c0, 0, assemblyThreads_ );
+        if ( !steady_ )
+            mf_->assemble( toPETSc( m_.matrixPtr() )->mat(), 0, 1, 0, assemblyThreads_ );
+        LOG( INFO ) << fmt::format( "{} elements assembled by {} threads", mf_->nElements(), assemblyThreads_ );
+    }
+    if ( !steady_ )
+        m_.close();
+    LOG( INFO ) << fmt::format( "time derivative rhs from the weighted mass matrix: {}", massRhs_ );
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::buildMatrixFreeOperator()
+{
+    double c0 = steady_ ? 0. : bdf_->polyDerivCoefficient( 0 );
+    mf_ = std::make_shared<MatrixFreeOperator<space_t>>( Xh_, Order );
+    for ( auto const& mat : materials_ )
+    {
+        if ( !mat.isConstant() )
+            throw std::invalid_argument( fmt::format( "matrix-free operator: the properties of material {} must be constant", mat.name ) );
+        mf_->addElements( markedelements( support( Xh_ ), mat.name ), mat.k.value(), mat.rho.value() * mat.Cp.value() );
+    }
+    if ( specs_["/BoundaryConditions/laplacian"_json_pointer].contains( "convective_laplacian_flux" ) )
+    {
+        for ( auto& [bc, value] : specs_["/BoundaryConditions/laplacian/convective_laplacian_flux"_json_pointer].items() )
+        {
+            Coefficient hc( value["h"] );
+            if ( !hc.isConstant() )
+                throw std::invalid_argument( fmt::format( "matrix-free operator: h on {} must be constant", bc ) );
+            mf_->addRobinFaces( markedfaces( support( Xh_ ), bc ), hc.value() );
+        }
+    }
+    mfA_ = mf_->shell( 1, c0, 1 );
+    if ( !steady_ )
+        mfM_ = mf_->shell( 0, 1, 0 );
+    if ( lowOrderPreconditioner() )
+        mfP_ = mf_->lowOrderMatrix( 1, c0, 1, 1 );
+    LOG( INFO ) << fmt::format( "matrix-free operator: {} elements, {} bytes", mf_->nElements(), mf_->memory() );
+}
+
+template <int Dim, int Order>
+bool Laplacian<Dim, Order>::lowOrderPreconditioner() const
+{
+    return matrixFree_ && get_value( specs_, "/Solver/laplacian/low_order_preconditioner", true );
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::assembleCutElements( MaterialProperties const& mat, std::vector<typename mesh_t::element_type const*> const& cut, double c0 )
+{
+    using kernels_t = SimplexKernels<Dim>;
+    constexpr int nPairs = kernels_t::nPairs;
+    if ( cut.empty() )
+        return;
+    auto const& pts = Xh_->fe()->points();
+    Eigen::MatrixXd nodes( Dim, pts.size2() );
+    for ( std::size_t i = 0; i < pts.size2(); ++i )
+        for ( int d = 0; d < Dim; ++d )
+            nodes( d, i ) = pts( d, i );
+    kernels_t kernels( nodes, Order );
+    int n = kernels.nLocalDofs();
+
+    MPI_Comm comm = Xh_->worldComm();
+    PetscErrorCode ierr;
+    Mat A = toPETSc( a_.matrixPtr() )->mat();
+    Mat M = steady_ ? nullptr : toPETSc( m_.matrixPtr() )->mat();
+    double k = mat.k.value(), rhoCp = mat.rho.value() * mat.Cp.value();
+    std::array<Eigen::MatrixXd, nPairs> T;
+    Eigen::MatrixXd Mr, Ke, Me;
+    Eigen::Matrix<double, Dim, Dim + 1> P;
+    Eigen::Matrix<double, nPairs, 1> G;
+    std::vector<PetscInt> idx( n );
+    for ( auto const* elt : cut )
+    {
+        for ( int v = 0; v <= Dim; ++v )
+            for ( int d = 0; d < Dim; ++d )
+                P( d, v ) = elt->point( v ).node()[d];
+        double det = kernels_t::geometry( P, G );
+        cutMatrices<Dim>( kernels, levelset_->values( *elt ), 2 * Order, T, Mr );
+        Me = ( rhoCp * det ) * Mr;
+        Ke = c0 * Me;
+        for ( int p = 0; p < nPairs; ++p )
+            Ke += ( k * G( p ) ) * T[p];
+        for ( int i = 0; i < n; ++i )
+            idx[i] = Xh_->dof()->mapGlobalProcessToGlobalCluster( Xh_->dof()->localToGlobal( elt->id(), i, 0 ).index() );
+        // the element matrices are symmetric, their column major storage is fine
+        ierr = MatSetValues( A, n, idx.data(), n, idx.data(), Ke.data(), ADD_VALUES );
+        CHKERRABORT( comm, ierr );
+        if ( M )
+        {
+            ierr = MatSetValues( M, n, idx.data(), n, idx.data(), Me.data(), ADD_VALUES );
+            CHKERRABORT( comm, ierr );
+        }
+    }
+    LOG( INFO ) << fmt::format( "material {}: {} cut elements integrated on their part inside the domain", mat.name, cut.size() );
+}
+
+// Process boundary conditions
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::processBoundaryConditions()
+{
+    auto timer = timings_.scope( "processBoundaryConditions" );
+    // BC Robin
+    if ( specs_["/BoundaryConditions/laplacian"_json_pointer].contains( "convective_laplacian_flux" ) )
+    {
+        for ( auto& [bc, value] : specs_["/BoundaryConditions/laplacian/convective_laplacian_flux"_json_pointer].items() )
+        {
+            LOG( INFO ) << fmt::format( "convective_laplacian_flux {}: {}", bc, value.dump() );
+            auto h = value["h"].get<std::string>();
+            // assembled at each step, see assembleTimeDependentOperator()
+            if ( !frozen_ && !steady_ && dependsOn( h, "t" ) )
+                continue;
+
+            // the Robin faces are in the operator, see buildMatrixFreeOperator()
+            if ( matrixFree_ )
+                continue;
+            if ( assemblyThreads_ > 0 )
+            {
+                if ( Coefficient hc( value["h"] ); hc.isConstant() )
+                {
+                    mf_->addRobinFaces( markedfaces( support( Xh_ ), bc ), hc.value() );
+                    continue;
+                }
+            }
+            a_ += integrate( _range = markedfaces( support( Xh_ ), bc ),
+                    _expr = parseExpr( h ) * id( v_ ) * idt( u_ ) );
+        }
+        if ( assemblyThreads_ > 0 && mf_->nFaces() > 0 )
+            mf_->assemble( toPETSc( a_.matrixPtr() )->mat(), 0, 0, 1, assemblyThreads_ );
+    }
+    assembleBoundaryRhs( specs_, l_ );
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::assembleBoundaryRhs( nl::json const& specs, form1_type& l )
+{
+    // BC Neumann
+    if ( specs["/BoundaryConditions/laplacian"_json_pointer].contains( "flux" ) )
+    {
+        for ( auto& [bc, value] : specs["/BoundaryConditions/laplacian/flux"_json_pointer].items() )
+        {
+            LOG( INFO ) << fmt::format( "flux {}: {}", bc, value.dump() );
+            auto flux = value["expr"].get<std::string>();
+
+            l += integrate( _range = markedfaces( support( Xh_ ), bc ),
+                    _expr = parseExpr( flux ) * id( v_ ) );
+        }
+    }
+
+    // BC Robin
+    if ( specs["/BoundaryConditions/laplacian"_json_pointer].contains( "convective_laplacian_flux" ) )
+    {
+        for ( auto& [bc, value] : specs["/BoundaryConditions/laplacian/convective_laplacian_flux"_json_pointer].items() )
+        {
+            auto h = value["h"].get<std::string>();
+            auto Text = value["Text"].get<std::string>();
+
+            l += integrate( _range = markedfaces( support( Xh_ ), bc ),
+                    _expr = parseExpr( h ) * parseExpr( Text ) * id( v_ ) );
+        }
+    }
+}
+
+// Run method (main method to run Laplacian process)
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::run()
+{
+    initialize();
+    processMaterials();
+    processBoundaryConditions();
+    // the time loops export every state, the last one included
+    timeLoop();
+
+    // timers of the run: aggregated over the ranks and/or as a trace
+    auto const& t = get_value( specs_, "/PostProcess/laplacian/Timings", nl::json::object() );
+    if ( t.contains( "filename" ) )
+    {
+        auto j = timings();
+        if ( Environment::isMasterRank() )
+            std::ofstream( Environment::expand( t["filename"].get<std::string>() ) ) << j.dump( 2 );
+    }
+    if ( t.contains( "trace" ) )
+        writeTrace( Environment::expand( t["trace"].get<std::string>() ) );
+}
+
+// Time loop
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::timeLoop()
+{
+    if ( steady_ )
+        return steadySolve();
+    if ( adaptive_.enabled )
+        return adaptiveTimeLoop();
+    auto timer = timings_.scope( "timeLoop" );
+    // a frozen operator is closed once and reused for every time step, only
+    // the right hand side is rebuilt. Otherwise a_ is its time invariant part
+    if ( !matrixFree_ )
+        a_.close();
+    // a time dependent operator sets up its preconditioner again at each
+    // step unless it is lagged with /Solver/laplacian/rebuild_every
+    int rebuildEvery = get_value( specs_, "/Solver/laplacian/rebuild_every", 0 );
+    double tlast = bdf_->timeInitial();
+    meas_.reserve( meas_.rows() + static_cast<std::size_t>( ( bdf_->timeFinal() - bdf_->timeInitial() ) / bdf_->timeStep() ) + 2 );
+
+    // time loop
+    for ( bdf_->start(); bdf_->isFinished()==false; bdf_->next(u_) )
+    {
+        auto step = timings_.scope( "timeLoop.step" );
+        {
+            auto assembly = timings_.scope( "timeLoop.assembly" );
+            if ( !frozen_ )
+                assembleTimeDependentOperator( bdf_->time() );
+            lt_ = l_;
+            lt_.close();
+            addTimeDerivative( *bdf_, toPETSc( lt_.vectorPtr() )->vec() );
+        }
+        {
+            auto solve = timings_.scope( "timeLoop.solve" );
+            this->solve( frozen_ ? a_ : at_, lt_, !frozen_ && rebuildEvery <= 0 );
+        }
+
+        time_ = bdf_->time();
+        {
+            auto exports = timings_.scope( "timeLoop.export" );
+            this->exportResults();
+        }
+        tlast = time_;
+
+        // u and the previous states become the history after next()
+        ++step_;
+        if ( checkpointDue( false ) )
+        {
+            std::vector<element_t const*> states{ &u_ };
+            auto const& unknowns = bdf_->unknowns();
+            for ( std::size_t i = 0; i + 1 < unknowns.size(); ++i )
+                states.push_back( unknowns[i].get() );
+            writeCheckpoint( states, bdf_->timeStep() );
+        }
+    }
+    if ( checkpointDue( true ) )
+    {
+        std::vector<element_t const*> states{ &u_ };
+        writeCheckpoint( states, bdf_->timeStep() );
+    }
+    finishExport( tlast );
+    reportSolverStats();
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::steadySolve()
+{
+    auto timer = timings_.scope( "timeLoop" );
+    MPI_Comm comm = Xh_->worldComm();
+    PetscErrorCode ierr;
+    auto& solver = linearSolver();
+    Mat A = operatorMatrix( a_ );
+    if ( !matrixFree_ )
+    {
+        // k grad u . grad v + h u v is symmetric positive definite
+        ierr = MatSetOption( A, MAT_SPD, PETSC_TRUE );
+        CHKERRABORT( comm, ierr );
+        ierr = MatSetOption( A, MAT_SYMMETRIC, PETSC_TRUE );
+        CHKERRABORT( comm, ierr );
+        ierr = MatSetOption( A, MAT_SYMMETRY_ETERNAL, PETSC_TRUE );
+        CHKERRABORT( comm, ierr );
+    }
+    solver.operatorChanged();
+
+    {
+        auto assembly = timings_.scope( "timeLoop.assembly" );
+        lt_ = l_;
+        lt_.close();
+    }
+    {
+        auto solve = timings_.scope( "timeLoop.solve" );
+        *x_ = u_;
+        x_->close();
+        timings_.add( "ksp.iterations", solver.solve( A, toPETSc( lt_.vectorPtr() )->vec(), x_->vec(), mfP_ ) );
+        // update the ghost values before copying back the solution
+        x_->close();
+        u_ = *x_;
+    }
+    {
+        auto exports = timings_.scope( "timeLoop.export" );
+        exportResults();
+    }
+    finishExport( time_ );
+    reportSolverStats();
+}
+
+template <int Dim, int Order>
+bool Laplacian<Dim, Order>::symmetricStorage() const
+{
+    return steady_ && !matrixFree_ && get_value( specs_, "/Solver/laplacian/symmetric_storage", false );
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::adaptiveTimeLoop()
+{
+    if ( !frozen_ || !massRhs_ )
+        throw std::invalid_argument( "adaptive time stepping: the operator and the weighted mass must not depend on time" );
+    auto timer = timings_.scope( "timeLoop" );
+    MPI_Comm comm = Xh_->worldComm();
+    PetscErrorCode ierr;
+    auto& solver = linearSolver();
+    double c0 = bdf_->polyDerivCoefficient( 0 );
+    Mat A0 = operatorMatrix( a_ ), M = massMatrix(), A = nullptr, P = nullptr;
+    auto un = toPETSc( backend()->newVector( Xh_ ) );
+    auto unm1 = toPETSc( backend()->newVector( Xh_ ) );
+    auto rhs = toPETSc( backend()->newVector( Xh_ ) );
+    auto w = toPETSc( backend()->newVector( Xh_ ) );
+    *un = u_;
+    un->close();
+    lt_ = l_;
+    lt_.close();
+    Vec l = toPETSc( lt_.vectorPtr() )->vec();
+
+    auto const& ctl = adaptive_;
+    double t = bdf_->timeInitial(), tf = bdf_->timeFinal();
+    double dt = bdf_->timeStep(), dtPrev = 0, dtA = 0;
+    int accepted = 0, rejected = 0;
+    // the previous state and step of a checkpoint give the error estimate of the first step
+    element_t previous = Xh_->element();
+    if ( restartStates_.size() > 1 && restartDt_ > 0 )
+    {
+        setLocalValues( previous, restartStates_[1] );
+        *unm1 = previous;
+        unm1->close();
+        dtPrev = restartDt_;
+        dt = std::clamp( restartDt_, ctl.dtMin, ctl.dtMax );
+    }
+    while ( t < tf - 1e-10 * dt )
+    {
+        auto step = timings_.scope( "timeLoop.step" );
+        bool estimated = dtPrev > 0;
+        dt = std::min( dt, tf - t );
+        if ( dt != dtA )
+        {
+            // a new step changes the operator and its preconditioner
+            if ( matrixFree_ )
+            {
+                if ( !A )
+                    A = mf_->shell( 1, 1 / dt, 1 );
+                else
+                    mf_->setScaling( A, 1, 1 / dt, 1 );
+                if ( lowOrderPreconditioner() && !P )
+                    P = mf_->lowOrderMatrix( 1, 1 / dt, 1, 1 );
+                else if ( P )
+                    mf_->assembleLowOrder( P, 1, 1 / dt, 1, 1 );
+            }
+            else
+            {
+                ierr = A ? MatCopy( A0, A, SAME_NONZERO_PATTERN ) : MatDuplicate( A0, MAT_COPY_VALUES, &A );
+                CHKERRABORT( comm, ierr );
+                ierr = MatAXPY( A, 1 / dt - c0, M, SUBSET_NONZERO_PATTERN );
+                CHKERRABORT( comm, ierr );
+            }
+            solver.operatorChanged();
+            dtA = dt;
+        }
+
+        // rhs = l + M u^n / dt
+        ierr = MatMult( M, un->vec(), rhs->vec() );
+        CHKERRABORT( comm, ierr );
+        ierr = VecAYPX( rhs->vec(), 1 / dt, l );
+        CHKERRABORT( comm, ierr );
+        ierr = VecCopy( un->vec(), x_->vec() );
+        CHKERRABORT( comm, ierr );
+        {
+            auto solve = timings_.scope( "timeLoop.solve" );
+            timings_.add( "ksp.iterations", solver.solve( A, rhs->vec(), x_->vec(), P ) );
+        }
+
+        // local error from the linear extrapolation of the two previous states
+        double err = 0;
+        if ( estimated )
+        {
+            ierr = VecAXPBYPCZ( w->vec(), 1 + dt / dtPrev, -dt / dtPrev, 0, un->vec(), unm1->vec() );
+            CHKERRABORT( comm, ierr );
+            ierr = VecAXPY( w->vec(), -1, x_->vec() );
+            CHKERRABORT( comm, ierr );
+            PetscReal dn, xn;
+            VecNorm( w->vec(), NORM_INFINITY, &dn );
+            VecNorm( x_->vec(), NORM_INFINITY, &xn );
+            err = dt / ( dt + dtPrev ) * dn / std::max( xn, 1e-12 );
+        }
+        if ( !ctl.accept( dt, err ) )
+        {
+            ++rejected;
+            LOG( INFO ) << fmt::format( "step rejected at t={} with dt={}, error {}", t, dt, err );
+            dt = ctl.next( dt, err );
+            continue;
+        }
+
+        ++accepted;
+        ierr = VecCopy( un->vec(), unm1->vec() );
+        CHKERRABORT( comm, ierr );
+        ierr = VecCopy( x_->vec(), un->vec() );
+        CHKERRABORT( comm, ierr );
+        t += dt;
+        dtPrev = dt;
+        // update the ghost values before copying back the solution
+        x_->close();
+        u_ = *x_;
+        time_ = t;
+        meas_.set( "dt", dt );
+        {
+            auto exports = timings_.scope( "timeLoop.export" );
+            exportResults();
+        }
+
+        // steady state when the relative change over the step is small
+        if ( ctl.steadyTol > 0 )
+        {
+            ierr = VecWAXPY( w->vec(), -1, unm1->vec(), un->vec() );
+            CHKERRABORT( comm, ierr );
+            PetscReal dn, un2;
+            VecNorm( w->vec(), NORM_2, &dn );
+            VecNorm( un->vec(), NORM_2, &un2 );
+            if ( dn <= ctl.steadyTol * std::max( un2, 1e-12 ) )
+            {
+                LOG( INFO ) << fmt::format( "steady state reached at t={}", t );
+                break;
+            }
+        }
+        ++step_;
+        if ( checkpointDue( false ) )
+        {
+            previous = *unm1;
+            writeCheckpoint( { &u_, &previous }, dtPrev );
+        }
+
+        // no estimate on the first step, the step is kept
+        if ( estimated )
+            dt = ctl.next( dt, err );
+    }
+    if ( A && !matrixFree_ )
+        MatDestroy( &A );
+    if ( checkpointDue( true ) )
+    {
+        previous = *unm1;
+        writeCheckpoint( { &u_, &previous }, dtPrev );
+    }
+    finishExport( time_ );
+    if ( Environment::isMasterRank() )
+        std::cout << fmt::format( "[laplacian] adaptive time loop: {} steps, {} rejected, final time {}", accepted, rejected, time_ ) << std::endl;
+    reportSolverStats();
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::reportSolverStats() const
+{
+    LOG( INFO ) << fmt::format( "solver stats: {}", solverStats().dump() );
+    if ( solver_ && Environment::isMasterRank() )
+        std::cout << fmt::format( "[laplacian] solver setups: {} ({:.3f}s), solves: {} ({:.3f}s), iterations: {}",
+                                  solver_->stats().setups, solver_->stats().setupTime,
+                                  solver_->stats().solves, solver_->stats().solveTime,
+                                  solver_->stats().iterations ) << std::endl;
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::assembleTimeDependentOperator( double t )
+{
+    auto timer = timings_.scope( "assembleTimeDependentOperator" );
+    double c0 = bdf_->polyDerivCoefficient( 0 );
+    at_ = a_;
+    for ( auto& mat : materials_ )
+    {
+        if ( !mat.isTimeDependent() )
+            continue;
+        mat.k.setParameterValues( { { "t", t } } );
+        mat.rho.setParameterValues( { { "t", t } } );
+        mat.Cp.setParameterValues( { { "t", t } } );
+        withCoefficient( mat.k, [&]( auto const& k ) {
+            withProduct( mat.rho, mat.Cp, [&]( auto const& rhoCp ) {
+                at_ += integrate( _range = markedelements( support( Xh_ ), mat.name ),
+                        _expr = c0 * rhoCp * idt( u_ ) * id( v_ ) + k * gradt( u_ ) * trans( grad( v_ ) ) );
+            } );
+        } );
+    }
+    if ( specs_["/BoundaryConditions/laplacian"_json_pointer].contains( "convective_laplacian_flux" ) )
+    {
+        for ( auto& [bc, value] : specs_["/BoundaryConditions/laplacian/convective_laplacian_flux"_json_pointer].items() )
+        {
+            auto h = value["h"].get<std::string>();
+            if ( !dependsOn( h, "t" ) )
+                continue;
+            auto e = parseExpr( h );
+            e.setParameterValues( { { "t", t } } );
+            at_ += integrate( _range = markedfaces( support( Xh_ ), bc ), _expr = e * id( v_ ) * idt( u_ ) );
+        }
+    }
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::addTimeDerivative( Bdf<space_t>& bdf, Vec rhs )
+{
+    if ( massRhs_ )
+    {
+        // rhs += M polyDeriv with one sparse matrix-vector product
+        if ( !w_ )
+            w_ = toPETSc( backend()->newVector( Xh_ ) );
+        *w_ = bdf.polyDeriv();
+        w_->close();
+        PetscErrorCode ierr = MatMultAdd( massMatrix(), w_->vec(), rhs, rhs );
+        CHKERRABORT( Xh_->worldComm(), ierr );
+        return;
+    }
+    auto polyDeriv = bdf.polyDeriv();
+    auto l = form1( _test = Xh_ );
+    for ( auto& mat : materials_ )
+    {
+        mat.rho.setParameterValues( { { "t", bdf.time() } } );
+        mat.Cp.setParameterValues( { { "t", bdf.time() } } );
+        withProduct( mat.rho, mat.Cp, [&]( auto const& rhoCp ) {
+            l += integrate( _range = markedelements( support( Xh_ ), mat.name ),
+                            _expr = rhoCp * idv( polyDeriv ) * id( v_ ) );
+        } );
+    }
+    l.close();
+    PetscErrorCode ierr = VecAXPY( rhs, 1., toPETSc( l.vectorPtr() )->vec() );
+    CHKERRABORT( Xh_->worldComm(), ierr );
+}
+
+template <int Dim, int Order>
+LinearSolver& Laplacian<Dim, Order>::linearSolver()
+{
+    if ( !solver_ )
+    {
+        solverTypes_ = solverTypes();
+        solver_ = std::make_shared<LinearSolver>( Xh_->worldComm(), "laplacian_",
+                                                  solverTypes_.first, solverTypes_.second,
+                                                  get_value( specs_, "/Solver/laplacian/ksp-rtol", doption( "ksp-rtol" ) ),
+                                                  get_value( specs_, "/Solver/laplacian/ksp-maxit", ioption( "ksp-maxit" ) ) );
+        solver_->setReusePreconditioner( get_value( specs_, "/Solver/laplacian/reuse_preconditioner", true ) );
+        solver_->setRebuildEvery( get_value( specs_, "/Solver/laplacian/rebuild_every", 0 ) );
+        // true or { "inner_rtol": 1e-3, "inner_maxit": 1000, "max_refinements": 30 }
+        solver_->setMixedPrecision( MixedPrecisionSolver::Options( get_value( specs_, "/Solver/laplacian/mixed_precision", nl::json() ) ) );
+        x_ = toPETSc( backend()->newVector( Xh_ ) );
+        solverSpace_ = Xh_;
+    }
+    return *solver_;
+}
+
+template <int Dim, int Order>
+std::pair<std::string, std::string> Laplacian<Dim, Order>::solverTypes() const
+{
+    // the steady operator is symmetric positive definite: conjugate
+    // gradient with algebraic multigrid, or with a preconditioner
+    // supporting the symmetric storage
+    std::string ksp = steady_ ? "cg" : soption( "ksp-type" );
+    std::string pc = matrixFree_ ? ( lowOrderPreconditioner() ? "gamg" : "jacobi" ) : !steady_ ? soption( "pc-type" ) : !symmetricStorage() ? "gamg"
+                                            : Xh_->worldComm().size() == 1 ? "icc" : "jacobi";
+    return { get_value( specs_, "/Solver/laplacian/ksp-type", ksp ), get_value( specs_, "/Solver/laplacian/pc-type", pc ) };
+}
+
+template <int Dim, int Order>
+Mat Laplacian<Dim, Order>::operatorMatrix( form2_type& a )
+{
+    if ( matrixFree_ )
+        return mfA_;
+    a.close();
+    Mat A = toPETSc( a.matrixPtr() )->mat();
+    if ( &a == &a_ && symmetricStorage() )
+    {
+        // PETSc converts assembled matrices only: the first assembly gives
+        // the pattern, then the matrix of a_ keeps its upper triangle and
+        // the later assemblies skip the lower one
+        MPI_Comm comm = Xh_->worldComm();
+        PetscBool sbaij = PETSC_FALSE;
+        PetscErrorCode ierr = PetscObjectTypeCompareAny( (PetscObject)A, &sbaij, MATSEQSBAIJ, MATMPISBAIJ, "" );
+        CHKERRABORT( comm, ierr );
+        if ( !sbaij )
+        {
+            ierr = MatConvert( A, MATSBAIJ, MAT_INPLACE_MATRIX, &A );
+            CHKERRABORT( comm, ierr );
+            ierr = MatSetOption( A, MAT_IGNORE_LOWER_TRIANGULAR, PETSC_TRUE );
+            CHKERRABORT( comm, ierr );
+        }
+    }
+    return A;
+}
+
+template <int Dim, int Order>
+Mat Laplacian<Dim, Order>::massMatrix()
+{
+    return matrixFree_ ? mfM_ : toPETSc( m_.matrixPtr() )->mat();
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::solve( form2_type& a, form1_type& l, bool operatorChanged )
+{
+    linearSolver();
+    if ( operatorChanged )
+        solver_->operatorChanged();
+
+    l.close();
+    *x_ = u_;
+    x_->close();
+    timings_.add( "ksp.iterations", solver_->solve( operatorMatrix( a ), toPETSc( l.vectorPtr() )->vec(), x_->vec(), mfP_ ) );
+    // update the ghost values before copying back the solution
+    x_->close();
+    u_ = *x_;
+}
+
+template <int Dim, int Order>
+std::string Laplacian<Dim, Order>::operatorKey( nl::json specs )
+{
+    // the flux and the exterior temperature only enter the right hand side
+    auto p = "/BoundaryConditions/laplacian"_json_pointer;
+    if ( specs.contains( p ) )
+    {
+        auto& bcs = specs[p];
+        bcs.erase( "flux" );
+        if ( bcs.contains( "convective_laplacian_flux" ) )
+            for ( auto& [bc, value] : bcs["convective_laplacian_flux"].items() )
+                value.erase( "Text" );
+    }
+    specs.erase( "PostProcess" );
+    return specs.dump();
+}
+
+template <int Dim, int Order>
+Eigen::MatrixXd Laplacian<Dim, Order>::solveBatch( std::vector<nl::json> const& overrides )
+{
+    auto timer = timings_.scope( "solveBatch" );
+    if ( !Xh_ )
+    {
+        initializeMesh();
+        initializeSpace();
+    }
+    nl::json base = specs_;
+    // the fields of the samples would overwrite each other
+    ExportPolicy policy = exportPolicy_;
+    exportPolicy_.mode = ExportPolicy::Mode::None;
+
+    // the model is initialized once, every sample starts from the initial
+    // conditions of the specs: a checkpoint belongs to one parameter set
+    auto restart = "/TimeStepping/laplacian/restart"_json_pointer;
+    if ( specs_.contains( restart ) )
+        specs_[restart] = false;
+    initializeModel();
+    element_t u0 = u_;
+
+    std::vector<nl::json> specs( overrides.size(), base );
+    std::map<std::string, std::vector<int>> groups;
+    for ( std::size_t s = 0; s < overrides.size(); ++s )
+    {
+        specs[s].merge_patch( overrides[s] );
+        groups[operatorKey( specs[s] )].push_back( static_cast<int>( s ) );
+    }
+    LOG( INFO ) << fmt::format( "batch of {} samples with {} distinct operators", overrides.size(), groups.size() );
+
+    std::size_t n = u_.map().nLocalDofWithGhost();
+    Eigen::MatrixXd U( overrides.size(), n );
+    std::vector<double> times( overrides.size() );
+    MPI_Comm comm = Xh_->worldComm();
+    PetscErrorCode ierr;
+    for ( auto const& [key, samples] : groups )
+    {
+        // only the operator and the time scheme change from a group to the next
+        specs_ = specs[samples.front()];
+        initializeOperator();
+        if ( !frozen_ )
+            throw std::invalid_argument( fmt::format( "solveBatch: the operator of sample {} depends on time, its samples cannot share it, use run()", samples.front() ) );
+        u_ = u0;
+        bdf_ = steady_ ? nullptr : createBdf( "bdf" );
+        if ( !steady_ )
+            bdf_->initialize( u_ );
+        processMaterials();
+        processBoundaryConditions();
+        Mat A = operatorMatrix( a_ );
+        auto& solver = linearSolver();
+        solver.operatorChanged();
+
+        int nrhs = static_cast<int>( samples.size() );
+        std::vector<vector_ptr_t> rhs( nrhs );
+        std::vector<bdf_ptrtype> bdfs( nrhs );
+        std::vector<element_t> us( nrhs, u0 );
+        for ( int j = 0; j < nrhs; ++j )
+        {
+            auto l = form1( _test = Xh_ );
+            assembleBoundaryRhs( specs[samples[j]], l );
+            l.close();
+            rhs[j] = toPETSc( l.vectorPtr() );
+            bdfs[j] = createBdf( fmt::format( "laplacian-batch{}", samples[j] ) );
+            bdfs[j]->initialize( us[j] );
+        }
+
+        PetscInt nlocal;
+        ierr = VecGetLocalSize( x_->vec(), &nlocal );
+        CHKERRABORT( comm, ierr );
+        Mat B, X;
+        ierr = MatCreateDense( comm, nlocal, PETSC_DECIDE, PETSC_DETERMINE, nrhs, nullptr, &B );
+        CHKERRABORT( comm, ierr );
+        ierr = MatDuplicate( B, MAT_DO_NOT_COPY_VALUES, &X );
+        CHKERRABORT( comm, ierr );
+
+        for ( auto& b : bdfs )
+            b->start();
+        for ( ; !bdfs.front()->isFinished(); )
+        {
+            for ( int j = 0; j < nrhs; ++j )
+            {
+                Vec c;
+                ierr = MatDenseGetColumnVecWrite( B, j, &c );
+                CHKERRABORT( comm, ierr );
+                ierr = VecCopy( rhs[j]->vec(), c );
+                CHKERRABORT( comm, ierr );
+                if ( !steady_ )
+                    addTimeDerivative( *bdfs[j], c );
+                ierr = MatDenseRestoreColumnVecWrite( B, j, &c );
+                CHKERRABORT( comm, ierr );
+
+                // previous state as initial guess
+                *x_ = us[j];
+                x_->close();
+                ierr = MatDenseGetColumnVecWrite( X, j, &c );
+                CHKERRABORT( comm, ierr );
+                ierr = VecCopy( x_->vec(), c );
+                CHKERRABORT( comm, ierr );
+                ierr = MatDenseRestoreColumnVecWrite( X, j, &c );
+                CHKERRABORT( comm, ierr );
+            }
+            timings_.add( "ksp.iterations", solver.solve( A, B, X ) );
+            for ( int j = 0; j < nrhs; ++j )
+            {
+                Vec c;
+                ierr = MatDenseGetColumnVecRead( X, j, &c );
+                CHKERRABORT( comm, ierr );
+                ierr = VecCopy( c, x_->vec() );
+                CHKERRABORT( comm, ierr );
+                ierr = MatDenseRestoreColumnVecRead( X, j, &c );
+                CHKERRABORT( comm, ierr );
+                // update the ghost values before copying back the solution
+                x_->close();
+                us[j] = *x_;
+                times[samples[j]] = bdfs[j]->time();
+                bdfs[j]->next( us[j] );
+            }
+        }
+        MatDestroy( &B );
+        MatDestroy( &X );
+
+        for ( int j = 0; j < nrhs; ++j )
+            for ( std::size_t i = 0; i < n; ++i )
+                U( samples[j], i ) = us[j]( i );
+    }
+
+    // measures of the final states in the order of the samples
+    meas_.clear();
+    for ( std::size_t s = 0; s < overrides.size(); ++s )
+    {
+        for ( std::size_t i = 0; i < n; ++i )
+            u_( i ) = U( s, i );
+        exportResults( times[s], u_ );
+    }
+    meas_.flush();
+
+    // back to the operator of the specs and the initial state
+    specs_ = base;
+    exportPolicy_ = policy;
+    initializeOperator();
+    u_ = u0;
+    bdf_ = steady_ ? nullptr : createBdf( "bdf" );
+    if ( !steady_ )
+        bdf_->initialize( u_ );
+    return U;
+}
+
+template <int Dim, int Order>
+bool Laplacian<Dim, Order>::isOperatorTimeInvariant() const
+{
+    for ( auto const& mat : materials_ )
+        if ( mat.isTimeDependent() )
+            return false;
+    if ( specs_["/BoundaryConditions/laplacian"_json_pointer].contains( "convective_laplacian_flux" ) )
+    {
+        for ( auto& [bc, value] : specs_["/BoundaryConditions/laplacian/convective_laplacian_flux"_json_pointer].items() )
+            if ( dependsOn( value["h"].get<std::string>(), "t" ) )
+                return false;
+    }
+    return true;
+}
+
+// Export results
+template <int Dim, int Order>
+MeasuresStore const& Laplacian<Dim, Order>::exportResults( double t, element_t const& u ) const
+{
+    auto timer = timings_.scope( "exportResults" );
+    if ( exportPolicy_.shouldExport( exportStep_++, t, lastExportTime_ ) )
+        exportFields( t, u );
+
+    if ( !post_ || post_->mesh != mesh_.get() || post_->space.lock() != Xh_ )
+        buildPostProcess();
+    auto& post = *post_;
+
+    // all the measures are linear functionals of u: evaluate them together
+    // with a single sweep over u and one reduction
+    *post.u = u;
+    post.u->close();
+    std::vector<PetscScalar> values( post.vecs.size() );
+    PetscErrorCode ierr = VecMDot( post.u->vec(), static_cast<PetscInt>( post.vecs.size() ), post.vecs.data(), values.data() );
+    CHKERRABORT( Xh_->worldComm(), ierr );
+    PetscReal umin, umax;
+    ierr = VecMin( post.u->vec(), nullptr, &umin );
+    CHKERRABORT( Xh_->worldComm(), ierr );
+    ierr = VecMax( post.u->vec(), nullptr, &umax );
+    CHKERRABORT( Xh_->worldComm(), ierr );
+
+    meas_.set( "time", t );
+    meas_.set( "min", umin );
+    meas_.set( "max", umax );
+    for ( std::size_t i = 0; i < post.functionals.size(); ++i )
+    {
+        auto const& f = post.functionals[i];
+        meas_.set( f.column, values[i] );
+        if ( !f.meanColumn.empty() )
+            meas_.set( f.meanColumn, values[i] / f.measure );
+    }
+    meas_.commit();
+    return meas_;
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::buildPostProcess() const
+{
+    auto post = std::make_shared<PostProcess>();
+    post->mesh = mesh_.get();
+    post->space = Xh_;
+    post->u = toPETSc( backend()->newVector( Xh_ ) );
+    auto add = [this, &post]( std::string const& column, std::string const& meanColumn, double meas, auto const& range, auto const& e )
+    {
+        auto l = form1( _test = Xh_ );
+        l += integrate( _range = range, _expr = e );
+        l.close();
+        post->functionals.push_back( { column, meanColumn, meas, l.vectorPtr() } );
+        post->vecs.push_back( toPETSc( l.vectorPtr() )->vec() );
+    };
+    post->measure = measure( _range = elements( mesh_ ), _expr = cst( 1.0 ) );
+    add( "totalQuantity", "mean", post->measure, elements( mesh_ ), id( v_ ) );
+    add( "totalFlux", "", 0, boundaryfaces( mesh_ ), grad( v_ ) * N() );
+    for( auto [key,values] : mesh_->markerNames())
+    {
+        if ( values[1] == Dim )
+        {
+            double meas = measure( _range = markedelements( mesh_, key ), _expr = cst( 1.0 ) );
+            post->measures[key] = meas;
+            add( fmt::format( "quantity_{}", key ), fmt::format( "mean_{}", key ), meas, markedelements( mesh_, key ), id( v_ ) );
+        }
+        else if ( values[1] == Dim-1 )
+        {
+            double meas = measure( _range = markedfaces( mesh_, key ), _expr = cst( 1.0 ) );
+            post->measures[key] = meas;
+            add( fmt::format( "quantity_{}", key ), fmt::format( "mean_{}", key ), meas, markedfaces( mesh_, key ), id( v_ ) );
+            add( fmt::format( "flux_{}", key ), "", 0, markedfaces( mesh_, key ), grad( v_ ) * N() );
+        }
+    }
+    post_ = post;
+}
+
+template <int Dim, int Order>
+typename Laplacian<Dim, Order>::p0_element_t Laplacian<Dim, Order>::errorIndicator() const
+{
+    auto timer = timings_.scope( "errorIndicator" );
+    auto P0h = Pdh<0>( mesh_ );
+    auto value = [this]( std::string const& s ) {
+        auto e = parseExpr( s );
+        e.setParameterValues( { { "t", time_ } } );
+        return e;
+    };
+    // conductivity per element, constant on the elements of a material
+    auto kh = P0h->element();
+    for ( auto const& mat : materials_ )
+    {
+        if ( mat.k.isConstant() )
+            kh.on( _range = markedelements( mesh_, mat.name ), _expr = cst( mat.k.value() ) );
+        else
+            kh.on( _range = markedelements( mesh_, mat.name ), _expr = value( mat.k.string() ) );
+    }
+
+    auto e = P0h->element();
+    auto F = backend()->newVector( P0h );
+    auto eta = form1( _test = P0h, _vector = F );
+    auto flux = idv( kh ) * gradv( u_ ) * N();
+    // the second derivatives vanish on the P1 elements
+    if constexpr ( Order > 1 )
+        eta += integrate( _range = elements( mesh_ ),
+                          _expr = h() * h() * idv( kh ) * idv( kh ) * laplacianv( u_ ) * laplacianv( u_ ) * id( e ) );
+    // the jump of the flux is shared by the two elements of the face
+    eta += integrate( _range = internalfaces( mesh_ ),
+                      _expr = hFace() * ( leftfacev( flux ) + rightfacev( flux ) ) * ( leftfacev( flux ) + rightfacev( flux ) ) * avg( id( e ) ) );
+
+    auto bcs = get_value( specs_, "/BoundaryConditions/laplacian", nl::json::object() );
+    if ( bcs.contains( "flux" ) )
+    {
+        for ( auto const& [bc, v] : bcs["flux"].items() )
+        {
+            auto r = value( v["expr"].get<std::string>() ) - flux;
+            eta += integrate( _range = markedfaces( mesh_, bc ), _expr = hFace() * r * r * id( e ) );
+        }
+    }
+    if ( bcs.contains( "convective_laplacian_flux" ) )
+    {
+        for ( auto const& [bc, v] : bcs["convective_laplacian_flux"].items() )
+        {
+            auto r = value( v["h"].get<std::string>() ) * ( value( v["Text"].get<std::string>() ) - idv( u_ ) ) - flux;
+            eta += integrate( _range = markedfaces( mesh_, bc ), _expr = hFace() * r * r * id( e ) );
+        }
+    }
+    F->close();
+    e = *F;
+    return e;
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::exportFields( double t, element_t const& u ) const
+{
+    if ( t == lastExportTime_ )
+        return;
+    if ( !writer_ )
+        writer_ = std::make_shared<AsyncExporter<mesh_t, element_t>>( exporter(), exportPolicy_.async, exportPolicy_.queue );
+    writer_->push( t, u );
+    lastExportTime_ = t;
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::finishExport( double t ) const
+{
+    if ( exportPolicy_.mode != ExportPolicy::Mode::None )
+        exportFields( t, u_ );
+    // joins the background thread, a later export starts a new writer
+    writer_.reset();
+    meas_.flush();
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::writeResultsToFile(const std::string& filename) const
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (file.is_open()) {
+        auto ext = std::filesystem::path( filename ).extension().string();
+        if ( ext == ".csv" )
+            meas_.writeCsv( file );
+        else if ( ext == ".bin" )
+            meas_.writeBinary( file );
+        else
+            file << meas_.toJson().dump(4);  // Indent of 4 spaces for readability
+        file.close();
+    } else {
+        std::cerr << "Unable to open file: " << filename << std::endl;
+    }
+}
+
+// Summary method
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::summary(/*arguments*/) {
+    /* ... summary code ... */
+}
+
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::addGradGrad( form2_type& a, std::vector<std::string> const& markers, Eigen::MatrixXd const& coeffs )
+{
+    for( auto marker : markers )
+    {
+        LOG( INFO ) << fmt::format( "assemble grad.grad on marker {} with coeffs: {}", marker, coeffs );
+        a += integrate( _range = markedelements( support( Xh_ ), marker ),
+                        _expr = trans(constant<Dim,Dim>(coeffs) * trans(gradt( u_ ))) * trans(grad( v_ )) );
+    }
+}
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::addMass( form2_type& a, std::vector<std::string> const& markers, double coeff )
+{
+    for( auto marker : markers )
+    {
+        if ( mesh_->markerNames().at(marker)[1] == Dim )
+        {
+            LOG( INFO ) << fmt::format( "assemble mass on volume marker {} with coeff: {}", marker, coeff );
+            a += integrate( _range = markedelements( support( Xh_ ), marker ),
+                        _expr = coeff * idt( u_ ) * id( v_ ) );
+        }
+        else if ( mesh_->markerNames().at(marker)[1] == Dim-1 )
+        {
+            LOG( INFO ) << fmt::format( "assemble mass on face marker {} with coeff: {}", marker, coeff );
+            a += integrate( _range = markedfaces( support( Xh_ ), marker ),
+                        _expr = coeff * idt( u_ ) * id( v_ ) );
+        }
+    }
+}
+template <int Dim, int Order>
+void Laplacian<Dim, Order>::addFlux( form1_type& l, std::vector<std::string> const& markers, double coeff )
+{
+    for( auto marker : markers )
+    {
+        if ( mesh_->markerNames().at(marker)[1] == Dim )
+        {
+            LOG( INFO ) << fmt::format( "assemble flux on volume marker {} with coeff: {}", marker, coeff );
+            l += integrate( _range = markedelements( support( Xh_ ), marker ),
+                            _expr = coeff * id( v_ ) );
+        }
+        else
+        {
+            LOG(INFO) << fmt::format("assemble flux on marker {} is a face marker with coeff: {}", marker, coeff);
+            l += integrate( _range = markedfaces( support( Xh_ ), marker ),
+                            _expr = coeff * id( v_ ) );
+        }
+    }
+}
+
+template <int Dim, int Order>
+typename Laplacian<Dim, Order>::form2_type
+Laplacian<Dim, Order>::assembleGradGrad( std::vector<std::string> const& markers, Eigen::MatrixXd const& coeffs )
+{
+    auto a = form2( _test = Xh_, _trial = Xh_ );
+    addGradGrad( a, markers, coeffs );
+    a.close();
+    return a;
+}
+template <int Dim, int Order>
+typename Laplacian<Dim, Order>::form2_type
+Laplacian<Dim, Order>::assembleMass( std::vector<std::string> const& markers, double coeff )
+{
+    auto a = form2( _test = Xh_, _trial = Xh_ );
+    addMass( a, markers, coeff );
+    a.close();
+    return a;
+}
+template <int Dim, int Order>
+typename Laplacian<Dim, Order>::form1_type
+Laplacian<Dim, Order>::assembleFlux( std::vector<std::string> const& markers, double coeff )
+{
+    auto l = form1( _test = Xh_ );
+    addFlux( l, markers, coeff );
+    l.close();
+    v_.setConstant(1);
+    LOG(INFO) << fmt::format("flux l(1)={}",l(v_)) << std::endl;
+    return l;
+}
+
+template <int Dim, int Order>
+sparse_matrix_ptrtype Laplacian<Dim, Order>::newMatrix() const
+{
+    auto M = backend()->newMatrix( _test = Xh_, _trial = Xh_ );
+    M->zero();
+    return M;
+}
+template <int Dim, int Order>
+sparse_matrix_ptrtype const&
+Laplacian<Dim, Order>::assembleGradGrad( sparse_matrix_ptrtype const& M, std::vector<std::string> const& markers, Eigen::MatrixXd const& coeffs, bool add )
+{
+    if ( !add )
+        M->zero();
+    auto a = form2( _test = Xh_, _trial = Xh_, _matrix = M );
+    addGradGrad( a, markers, coeffs );
+    a.close();
+    return M;
+}
+template <int Dim, int Order>
+sparse_matrix_ptrtype const&
+Laplacian<Dim, Order>::assembleMass( sparse_matrix_ptrtype const& M, std::vector<std::string> const& markers, double coeff, bool add )
+{
+    if ( !add )
+        M->zero();
+    auto a = form2( _test = Xh_, _trial = Xh_, _matrix = M );
+    addMass( a, markers, coeff );
+    a.close();
+    return M;
+}
+template <int Dim, int Order>
+vector_ptrtype const&
+Laplacian<Dim, Order>::assembleFlux( vector_ptrtype const& F, std::vector<std::string> const& markers, double coeff, bool add )
+{
+    if ( !add )
+        F->zero();
+    auto l = form1( _test = Xh_, _vector = F );
+    addFlux( l, markers, coeff );
+    l.close();
+    return F;
+}
+
+} // namespace Feel
@@ -0,0 +1,455 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief domains defined by a levelset with a narrow band of cut elements
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-20
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <feel/feeldiscr/pch.hpp>
+#include <feel/feelvf/vf.hpp>
+#include <fmt/core.h>
+
+#include "simplexkernels.hpp"
+#include "threading.hpp"
+
+namespace Feel
+{
+/**
+ * @brief quadrature on the part phi < 0 of a simplex
+ *
+ * phi is the linear interpolant of its values at the vertices. The part
+ * phi < 0 is split into sub-simplices, the rule of degree @p degree is mapped
+ * on each of them. A vertex where phi = 0 counts as outside.
+ *
+ * @param phi values at the vertices of the reference simplex of Feel++
+ * @param degree degree of exactness of the rule
+ * @return the points, one per column, in the reference coordinates of the simplex and the weights
+ */
+template <int Dim>
+std::pair<Eigen::MatrixXd, Eigen::VectorXd> cutSimplexQuadrature( Eigen::Matrix<double, Dim + 1, 1> const& phi, int degree )
+{
+    static_assert( Dim == 2 || Dim == 3, "cut quadrature in dimension 2 or 3" );
+    using point_t = Eigen::Matrix<double, Dim, 1>;
+    std::array<point_t, Dim + 1> vertices;
+    for ( int v = 0; v <= Dim; ++v )
+    {
+        vertices[v] = -point_t::Ones();
+        if ( v > 0 )
+            vertices[v]( v - 1 ) = 1;
+    }
+    std::vector<int> neg, pos;
+    for ( int v = 0; v <= Dim; ++v )
+        ( phi( v ) < 0 ? neg : pos ).push_back( v );
+    // point of phi = 0 on the edge from a negative to a positive vertex
+    auto cut = [&]( int a, int b ) -> point_t {
+        double t = phi( a ) / ( phi( a ) - phi( b ) );
+        return vertices[a] + t * ( vertices[b] - vertices[a] );
+    };
+
+    std::vector<std::array<point_t, Dim + 1>> simplices;
+    // prism with the bottom A and the top B, A_i B_i being the lateral edges
+    auto prism = [&]( std::array<point_t, Dim> const& A, std::array<point_t, Dim> const& B ) {
+        if constexpr ( Dim == 2 )
+        {
+            simplices.push_back( { A[0], A[1], B[1] } );
+            simplices.push_back( { A[0], B[1], B[0] } );
+        }
+        else
+        {
+            simplices.push_back( { A[0], A[1], A[2], B[0] } );
+            simplices.push_back( { A[1], A[2], B[0], B[1] } );
+            simplices.push_back( { A[2], B[0], B[1], B[2] } );
+        }
+    };
+    if ( pos.empty() )
+        simplices.push_back( vertices );
+    else if ( neg.size() == 1 )
+    {
+        // corner of the negative vertex
+        std::array<point_t, Dim + 1> s;
+        s[0] = vertices[neg[0]];
+        for ( int k = 0; k < Dim; ++k )
+            s[k + 1] = cut( neg[0], pos[k] );
+        simplices.push_back( s );
+    }
+    else if ( neg.size() == Dim )
+    {
+        // the negative face and its translate on the edges to the positive vertex
+        std::array<point_t, Dim> A, B;
+        for ( int k = 0; k < Dim; ++k )
+        {
+            A[k] = vertices[neg[k]];
+            B[k] = cut( neg[k], pos[0] );
+        }
+        prism( A, B );
+    }
+    else if constexpr ( Dim == 3 )
+    {
+        // tetrahedron with two negative vertices a, b and two positive c, d
+        if ( neg.size() == 2 )
+            prism( { vertices[neg[0]], cut( neg[0], pos[0] ), cut( neg[0], pos[1] ) },
+                   { vertices[neg[1]], cut( neg[1], pos[0] ), cut( neg[1], pos[1] ) } );
+    }
+
+    auto [rpts, rwts] = simplexQuadrature<Dim>( degree );
+    Eigen::MatrixXd pts( Dim, rpts.cols() * simplices.size() );
+    Eigen::VectorXd wts( rpts.cols() * simplices.size() );
+    int q = 0;
+    for ( auto const& s : simplices )
+    {
+        Eigen::Matrix<double, Dim, Dim> J;
+        for ( int d = 0; d < Dim; ++d )
+            J.col( d ) = ( s[d + 1] - s[0] ) / 2;
+        double det = std::abs( J.determinant() );
+        for ( int r = 0; r < rpts.cols(); ++r, ++q )
+        {
+            pts.col( q ) = s[0] + J * ( rpts.col( r ).array() + 1 ).matrix();
+            wts( q ) = rwts( r ) * det;
+        }
+    }
+    return { pts, wts };
+}
+
+/**
+ * @brief domain phi < 0 of a mesh for a levelset phi
+ *
+ * The levelset is interpolated once at the vertices of the mesh and each
+ * element is classified as inside, cut or outside. The active elements, the
+ * inside and cut ones, support the function space. The narrow band is made
+ * of the cut elements and of @c layers rings of their neighbours.
+ *
+ * When the levelset changes, update() evaluates it again on the vertices of
+ * the band only and classifies the elements of the band. This holds as long
+ * as the interface stays inside the band: the levelset is evaluated on the
+ * whole mesh if the interface reaches the outer ring, if the band has no cut
+ * element any more, or if a vertex of the rim of the band, shared with the
+ * elements outside, changes sign, e.g. when the interface jumps over the
+ * band. A component of the interface appearing away from the band is not
+ * seen by the band: build the domain with 0 layers for such levelsets. The key of the active elements,
+ * see activeKey(), changes only if the active elements change so that the
+ * space and its dof table can be reused when the interface moves within the
+ * active elements.
+ *
+ * The cut elements are integrated on their part phi < 0, see
+ * cutSimplexQuadrature() and cutMatrices().
+ */
+template <typename MeshType>
+class LevelsetDomain
+{
+public:
+    static constexpr int Dim = MeshType::nDim;
+    using mesh_ptrtype = std::shared_ptr<MeshType>;
+    using element_type = typename MeshType::element_type;
+    using range_type = Range<MeshType, MESH_ELEMENTS>;
+    enum class Status : std::uint8_t
+    {
+        Outside = 0,
+        Inside,
+        Cut
+    };
+
+    /**
+     * @param mesh affine simplex mesh
+     * @param layers number of rings of neighbours of the cut elements in the band, 0 evaluates the levelset on the whole mesh at each update
+     */
+    LevelsetDomain( mesh_ptrtype const& mesh, int layers = 2 )
+        : mesh_( mesh ),
+          layers_( std::max( 0, layers ) ),
+          Vh_( Pch<1>( mesh ) ),
+          phi_( Vh_->element() )
+    {
+        for ( auto const& eltWrap : elements( mesh_ ) )
+        {
+            auto const& elt = unwrap_ref( eltWrap );
+            index_[elt.id()] = elts_.size();
+            elts_.push_back( &elt );
+            std::array<std::size_t, Dim + 1> v;
+            for ( int i = 0; i <= Dim; ++i )
+                v[i] = Vh_->dof()->localToGlobal( elt.id(), i, 0 ).index();
+            vertices_.push_back( v );
+        }
+        // elements around each vertex
+        std::vector<std::vector<std::size_t>> around( Vh_->dof()->nLocalDofWithGhost() );
+        for ( std::size_t e = 0; e < elts_.size(); ++e )
+            for ( auto v : vertices_[e] )
+                around[v].push_back( e );
+        neighbours_.resize( elts_.size() );
+        for ( std::size_t e = 0; e < elts_.size(); ++e )
+        {
+            for ( auto v : vertices_[e] )
+                for ( auto n : around[v] )
+                    if ( n != e )
+                        neighbours_[e].push_back( n );
+            std::sort( neighbours_[e].begin(), neighbours_[e].end() );
+            neighbours_[e].erase( std::unique( neighbours_[e].begin(), neighbours_[e].end() ), neighbours_[e].end() );
+        }
+        status_.assign( elts_.size(), Status::Outside );
+    }
+
+    mesh_ptrtype const& mesh() const { return mesh_; }
+    std::string const& levelset() const { return levelset_; }
+    int layers() const { return layers_; }
+
+    /**
+     * @brief set the levelset, collective
+     *
+     * @param levelset expression of phi, e.g. "(x-0.5)^2+y^2-0.1:x:y"
+     * @return true if the active elements changed on a rank
+     */
+    bool update( std::string const& levelset )
+    {
+        if ( levelset == levelset_ )
+            return false;
+        auto e = parseExpr( levelset );
+        auto previous = status_;
+        int full = levelset_.empty() || layers_ == 0 || band_.empty();
+        if ( !full )
+        {
+            phi_.on( _range = bandRange(), _expr = e );
+            for ( auto b : band_ )
+                status_[b] = classify( b );
+            // the interface reached the outer ring of the band or left it
+            bool cut = false;
+            for ( auto b : band_ )
+                cut = cut || status_[b] == Status::Cut;
+            full = !cut;
+            for ( auto b : outerRing_ )
+                full = full || status_[b] == Status::Cut;
+            // the elements outside the band are not cut: the sign of phi on
+            // the rim is the one of their status
+            for ( auto const& [v, s] : rim_ )
+                full = full || ( s == Status::Inside ? phi_( v ) > 0 : phi_( v ) < 0 );
+        }
+        MPI_Allreduce( MPI_IN_PLACE, &full, 1, MPI_INT, MPI_LOR, mesh_->worldComm() );
+        if ( full )
+        {
+            phi_.on( _range = elements( mesh_ ), _expr = e );
+            for ( std::size_t k = 0; k < elts_.size(); ++k )
+                status_[k] = classify( k );
+            ++fullUpdates_;
+        }
+        levelset_ = levelset;
+        buildBand();
+
+        int changed = 0;
+        for ( std::size_t k = 0; k < elts_.size() && !changed; ++k )
+            changed = ( previous[k] == Status::Outside ) != ( status_[k] == Status::Outside );
+        MPI_Allreduce( MPI_IN_PLACE, &changed, 1, MPI_INT, MPI_LOR, mesh_->worldComm() );
+        if ( changed || activeKey_.empty() )
+            buildActive();
+        LOG( INFO ) << fmt::format( "levelset {}: {} active elements, {} cut, band of {} elements, full evaluation: {}",
+                                    levelset, active_.size(), cut_.size(), band_.size(), full != 0 );
+        return changed;
+    }
+
+    Status status( element_type const& elt ) const { return status_[index_.at( elt.id() )]; }
+    //! values of phi at the vertices of @p elt in the order of its points
+    Eigen::Matrix<double, Dim + 1, 1> values( element_type const& elt ) const
+    {
+        Eigen::Matrix<double, Dim + 1, 1> p;
+        auto const& v = vertices_[index_.at( elt.id() )];
+        for ( int i = 0; i <= Dim; ++i )
+            p( i ) = phi_( v[i] );
+        return p;
+    }
+    //! interpolant of phi at the vertices
+    typename Pch_type<MeshType, 1>::element_type const& phi() const { return phi_; }
+
+    //! inside and cut elements, the support of the space
+    range_type const& activeElements() const { return *activeRange_; }
+    //! key of the active elements of all the ranks
+    std::string const& activeKey() const { return activeKey_; }
+    std::size_t nActive() const { return active_.size(); }
+    std::size_t nCut() const { return cut_.size(); }
+    std::size_t nBand() const { return band_.size(); }
+    //! number of evaluations of the levelset on the whole mesh
+    int fullUpdates() const { return fullUpdates_; }
+
+    /**
+     * @brief elements of @p range by status
+     *
+     * @param inside elements of @p range inside the domain
+     * @param cut elements of @p range cut by the interface
+     */
+    template <typename RangeType>
+    void split( RangeType const& range, range_type& inside, std::vector<element_type const*>& cut ) const
+    {
+        for ( auto const& eltWrap : range )
+        {
+            auto const& elt = unwrap_ref( eltWrap );
+            auto s = status( elt );
+            if ( s == Status::Inside )
+                inside.push_back( elt );
+            else if ( s == Status::Cut )
+                cut.push_back( &elt );
+        }
+    }
+
+private:
+    Status classify( std::size_t k ) const
+    {
+        int neg = 0, pos = 0;
+        for ( auto v : vertices_[k] )
+        {
+            neg += phi_( v ) < 0;
+            pos += phi_( v ) > 0;
+        }
+        return neg == 0 ? Status::Outside : pos == 0 ? Status::Inside : Status::Cut;
+    }
+
+    range_type bandRange() const
+    {
+        range_type r( mesh_ );
+        for ( auto b : band_ )
+            r.push_back( *elts_[b] );
+        return r;
+    }
+
+    //! cut elements and layers rings of neighbours
+    void buildBand()
+    {
+        std::vector<char> in( elts_.size(), 0 );
+        std::vector<std::size_t> front;
+        cut_.clear();
+        for ( std::size_t k = 0; k < elts_.size(); ++k )
+            if ( status_[k] == Status::Cut )
+            {
+                cut_.push_back( k );
+                in[k] = 1;
+            }
+        band_ = cut_;
+        front = cut_;
+        outerRing_.clear();
+        for ( int l = 0; l < layers_; ++l )
+        {
+            std::vector<std::size_t> next;
+            for ( auto f : front )
+                for ( auto n : neighbours_[f] )
+                    if ( !in[n] )
+                    {
+                        in[n] = 1;
+                        next.push_back( n );
+                    }
+            band_.insert( band_.end(), next.begin(), next.end() );
+            front = std::move( next );
+        }
+        if ( layers_ > 0 )
+            outerRing_ = front;
+        // vertices shared by the outer ring and the elements outside the band
+        rim_.clear();
+        for ( auto f : outerRing_ )
+            for ( auto n : neighbours_[f] )
+                if ( !in[n] )
+                    for ( auto v : vertices_[n] )
+                        if ( std::find( vertices_[f].begin(), vertices_[f].end(), v ) != vertices_[f].end() )
+                            rim_.emplace_back( v, status_[n] );
+    }
+
+    void buildActive()
+    {
+        active_.clear();
+        activeRange_ = std::make_shared<range_type>( mesh_ );
+        // FNV-1a hash of the ids of the active elements, combined over the ranks
+        std::uint64_t h = 14695981039346656037ull;
+        for ( std::size_t k = 0; k < elts_.size(); ++k )
+        {
+            if ( status_[k] == Status::Outside )
+                continue;
+            active_.push_back( k );
+            activeRange_->push_back( *elts_[k] );
+            auto id = static_cast<std::uint64_t>( elts_[k]->id() );
+            for ( int b = 0; b < 8; ++b )
+                h = ( h ^ ( ( id >> ( 8 * b ) ) & 0xff ) ) * 1099511628211ull;
+        }
+        std::uint64_t key = h, n = active_.size();
+        MPI_Allreduce( MPI_IN_PLACE, &key, 1, MPI_UINT64_T, MPI_BXOR, mesh_->worldComm() );
+        MPI_Allreduce( MPI_IN_PLACE, &n, 1, MPI_UINT64_T, MPI_SUM, mesh_->worldComm() );
+        activeKey_ = fmt::format( "{}-{:016x}", n, key );
+    }
+
+    mesh_ptrtype mesh_;
+    int layers_ = 2;
+    Pch_ptrtype<MeshType, 1> Vh_;
+    typename Pch_type<MeshType, 1>::element_type phi_;
+    std::string levelset_;
+    std::vector<element_type const*> elts_;
+    std::map<size_type, std::size_t> index_;
+    std::vector<std::array<std::size_t, Dim + 1>> vertices_;
+    std::vector<std::vector<std::size_t>> neighbours_;
+    std::vector<Status> status_;
+    std::vector<std::size_t> cut_, band_, outerRing_, active_;
+    std::vector<std::pair<std::size_t, Status>> rim_;
+    std::shared_ptr<range_type> activeRange_;
+    std::string activeKey_;
+    int fullUpdates_ = 0;
+};
+
+/**
+ * @brief reference matrices of the part phi < 0 of a simplex
+ *
+ * the element matrices of a cut affine element are combinations of these
+ * matrices with the geometric factors of SimplexKernels::geometry(), as for
+ * the whole element
+ *
+ * @param kernels basis of the element
+ * @param phi values of the levelset at the vertices
+ * @param degree degree of exactness of the quadrature
+ * @param T symmetric parts of the stiffness for the pairs a <= b
+ * @param M mass
+ */
+template <int Dim>
+void cutMatrices( SimplexKernels<Dim> const& kernels, Eigen::Matrix<double, Dim + 1, 1> const& phi, int degree,
+                  std::array<Eigen::MatrixXd, SimplexKernels<Dim>::nPairs>& T, Eigen::MatrixXd& M )
+{
+    int n = kernels.nLocalDofs();
+    auto [pts, wts] = cutSimplexQuadrature<Dim>( phi, degree );
+    M.setZero( n, n );
+    for ( auto& t : T )
+        t.setZero( n, n );
+    for ( int q = 0; q < pts.cols(); ++q )
+    {
+        Eigen::VectorXd v = kernels.values( pts.col( q ) );
+        Eigen::MatrixXd g = kernels.gradients( pts.col( q ) );
+        M += wts( q ) * v * v.transpose();
+        for ( int a = 0, p = 0; a < Dim; ++a )
+            for ( int b = a; b < Dim; ++b, ++p )
+            {
+                Eigen::MatrixXd S = wts( q ) * g.col( b ) * g.col( a ).transpose();
+                T[p] += ( a == b ) ? S : Eigen::MatrixXd( S + S.transpose() );
+            }
+    }
+}
+
+} // namespace Feel
@@ -0,0 +1,300 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief PETSc linear solver reused across time steps
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-04
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include <feel/feelcore/environment.hpp>
+#include <feel/feelcore/json.hpp>
+#include <fmt/core.h>
+#include <petscksp.h>
+
+#include "mixedprecision.hpp"
+
+namespace Feel
+{
+/**
+ * @brief Krylov solver and preconditioner kept alive across solves
+ *
+ * The KSP and its preconditioner are set up on the first solve and then
+ * reused as long as the operator does not change. They are set up again
+ * when the operator is flagged as modified, when a different matrix is
+ * given or every @c rebuildEvery solves if it is positive.
+ *
+ * The preconditioner is built from the operator, or from another matrix
+ * when one is given, e.g. an assembled low order approximation of a shell
+ * operator.
+ *
+ * The setup (preconditioner build or factorization) and the solve times are
+ * accumulated separately, see stats().
+ *
+ * With setMixedPrecision(), the single right hand side solves of assembled
+ * operators run a Jacobi preconditioned CG in single precision inside a
+ * double precision iterative refinement, see MixedPrecisionSolver. The
+ * tolerances are the ones of the KSP.
+ */
+class LinearSolver
+{
+public:
+    struct Stats
+    {
+        int setups = 0;
+        int solves = 0;
+        int iterations = 0;
+        double setupTime = 0;
+        double solveTime = 0;
+
+        nl::json toJson() const
+        {
+            return nl::json{ { "setups", setups },
+                             { "solves", solves },
+                             { "iterations", iterations },
+                             { "setup_time", setupTime },
+                             { "solve_time", solveTime } };
+        }
+    };
+
+    /**
+     * @brief create the solver
+     *
+     * @param comm communicator of the operator
+     * @param prefix PETSc options prefix, e.g. "laplacian_" to use -laplacian_ksp_type
+     * @param ksptype Krylov method
+     * @param pctype preconditioner
+     * @param rtol relative tolerance
+     * @param maxit maximum number of iterations
+     */
+    LinearSolver( MPI_Comm comm, std::string const& prefix, std::string const& ksptype, std::string const& pctype,
+                  double rtol, int maxit )
+        : comm_( comm )
+    {
+        PetscErrorCode ierr = KSPCreate( comm_, &ksp_ );
+        CHKERRABORT( comm_, ierr );
+        ierr = KSPSetOptionsPrefix( ksp_, prefix.c_str() );
+        CHKERRABORT( comm_, ierr );
+        ierr = KSPSetType( ksp_, ksptype.c_str() );
+        CHKERRABORT( comm_, ierr );
+        PC pc;
+        ierr = KSPGetPC( ksp_, &pc );
+        CHKERRABORT( comm_, ierr );
+        ierr = PCSetType( pc, pctype.c_str() );
+        CHKERRABORT( comm_, ierr );
+        ierr = KSPSetTolerances( ksp_, rtol, PETSC_DEFAULT, PETSC_DEFAULT, maxit );
+        CHKERRABORT( comm_, ierr );
+        // the previous solution is a good initial guess in a time loop
+        ierr = KSPSetInitialGuessNonzero( ksp_, PETSC_TRUE );
+        CHKERRABORT( comm_, ierr );
+        ierr = KSPSetFromOptions( ksp_ );
+        CHKERRABORT( comm_, ierr );
+    }
+    LinearSolver( LinearSolver const& ) = delete;
+    LinearSolver& operator=( LinearSolver const& ) = delete;
+    ~LinearSolver()
+    {
+        KSPDestroy( &ksp_ );
+    }
+
+    //! set up the solver again every @p n solves, never if @p n <= 0
+    void setRebuildEvery( int n ) { rebuildEvery_ = n; }
+    int rebuildEvery() const { return rebuildEvery_; }
+
+    //! if false, the preconditioner is set up again at every solve
+    void setReusePreconditioner( bool r ) { reuse_ = r; }
+    bool reusePreconditioner() const { return reuse_; }
+
+    //! flag the operator as modified, the next solve sets up the preconditioner again
+    void operatorChanged() { rebuild_ = true; }
+
+    //! solve in mixed precision if @p o is enabled, the operator is copied again at the next solve
+    void setMixedPrecision( MixedPrecisionSolver::Options const& o )
+    {
+        if ( o.enabled )
+            mixed_ = std::make_unique<MixedPrecisionSolver>( comm_, o );
+        else
+            mixed_.reset();
+        rebuild_ = true;
+    }
+    bool mixedPrecision() const { return mixed_ != nullptr; }
+
+    KSP ksp() const { return ksp_; }
+    Stats const& stats() const { return stats_; }
+
+    /**
+     * @brief solve A x = b
+     *
+     * @param A operator, must be assembled
+     * @param b right hand side
+     * @param x initial guess and solution
+     * @param P matrix the preconditioner is built from, @p A if null
+     * @return the number of iterations
+     */
+    int solve( Mat A, Vec b, Vec x, Mat P = nullptr )
+    {
+        using clock = std::chrono::steady_clock;
+        if ( mixed_ && rowAccess( A ) )
+            return solveMixed( A, b, x );
+        setUp( A, P );
+        auto start = clock::now();
+        PetscErrorCode ierr = KSPSolve( ksp_, b, x );
+        CHKERRABORT( comm_, ierr );
+        stats_.solveTime += std::chrono::duration<double>( clock::now() - start ).count();
+        return finish( 1 );
+    }
+
+    /**
+     * @brief solve A X = B for several right hand sides at once
+     *
+     * the preconditioner is applied to all the right hand sides together, block
+     * Krylov methods (e.g. -ksp_type hpddm) solve them as a block
+     *
+     * @param A operator, must be assembled
+     * @param B dense matrix of the right hand sides, one per column
+     * @param X dense matrix of the solutions, same layout as @p B
+     * @param P matrix the preconditioner is built from, @p A if null
+     * @return the number of iterations
+     */
+    int solve( Mat A, Mat B, Mat X, Mat P = nullptr )
+    {
+        using clock = std::chrono::steady_clock;
+        setUp( A, P );
+        PetscInt nrhs;
+        PetscErrorCode ierr = MatGetSize( B, nullptr, &nrhs );
+        CHKERRABORT( comm_, ierr );
+        auto start = clock::now();
+        ierr = KSPMatSolve( ksp_, B, X );
+        CHKERRABORT( comm_, ierr );
+        stats_.solveTime += std::chrono::duration<double>( clock::now() - start ).count();
+        return finish( nrhs );
+    }
+
+private:
+    //! @return true if all the rows of @p A can be read, not for shell or symmetric block matrices
+    static bool rowAccess( Mat A )
+    {
+        MatType t;
+        MatGetType( A, &t );
+        std::string type( t );
+        return type != MATSHELL && type.find( "sbaij" ) == std::string::npos;
+    }
+
+    //! solve A x = b in mixed precision, the single precision copy of A plays the role of the preconditioner
+    int solveMixed( Mat A, Vec b, Vec x )
+    {
+        using clock = std::chrono::steady_clock;
+        if ( A != A_ )
+        {
+            A_ = A;
+            rebuild_ = true;
+        }
+        if ( rebuildEvery_ > 0 && solvesSinceSetup_ >= rebuildEvery_ )
+            rebuild_ = true;
+        if ( rebuild_ || !reuse_ )
+        {
+            auto start = clock::now();
+            mixed_->setOperator( A_ );
+            stats_.setupTime += std::chrono::duration<double>( clock::now() - start ).count();
+            ++stats_.setups;
+            solvesSinceSetup_ = 0;
+            rebuild_ = false;
+            // the KSP is set up again if it is used next
+            kspStale_ = true;
+        }
+        PetscReal rtol, atol;
+        PetscErrorCode ierr = KSPGetTolerances( ksp_, &rtol, &atol, nullptr, nullptr );
+        CHKERRABORT( comm_, ierr );
+        auto start = clock::now();
+        int its = mixed_->solve( b, x, rtol, atol );
+        stats_.solveTime += std::chrono::duration<double>( clock::now() - start ).count();
+        ++stats_.solves;
+        stats_.iterations += its;
+        ++solvesSinceSetup_;
+        return its;
+    }
+
+    //! set up the KSP and the preconditioner if needed
+    void setUp( Mat A, Mat P )
+    {
+        using clock = std::chrono::steady_clock;
+        if ( A != A_ || P != P_ )
+        {
+            A_ = A;
+            P_ = P;
+            rebuild_ = true;
+        }
+        if ( rebuildEvery_ > 0 && solvesSinceSetup_ >= rebuildEvery_ )
+            rebuild_ = true;
+        if ( kspStale_ )
+            rebuild_ = true;
+        if ( !rebuild_ && reuse_ )
+            return;
+        auto start = clock::now();
+        PetscErrorCode ierr = KSPSetReusePreconditioner( ksp_, PETSC_FALSE );
+        CHKERRABORT( comm_, ierr );
+        ierr = KSPSetOperators( ksp_, A_, P_ ? P_ : A_ );
+        CHKERRABORT( comm_, ierr );
+        ierr = KSPSetUp( ksp_ );
+        CHKERRABORT( comm_, ierr );
+        ierr = KSPSetReusePreconditioner( ksp_, PETSC_TRUE );
+        CHKERRABORT( comm_, ierr );
+        stats_.setupTime += std::chrono::duration<double>( clock::now() - start ).count();
+        ++stats_.setups;
+        solvesSinceSetup_ = 0;
+        rebuild_ = false;
+        kspStale_ = false;
+    }
+
+    //! check the convergence and update the statistics after solving @p nrhs systems
+    int finish( int nrhs )
+    {
+        PetscInt its;
+        PetscErrorCode ierr = KSPGetIterationNumber( ksp_, &its );
+        CHKERRABORT( comm_, ierr );
+        KSPConvergedReason reason;
+        ierr = KSPGetConvergedReason( ksp_, &reason );
+        CHKERRABORT( comm_, ierr );
+        if ( reason < 0 )
+            LOG( WARNING ) << fmt::format( "linear solver diverged after {} iterations, reason: {}", its, KSPConvergedReasons[reason] );
+        stats_.solves += nrhs;
+        stats_.iterations += its;
+        ++solvesSinceSetup_;
+        return its;
+    }
+
+    MPI_Comm comm_;
+    KSP ksp_ = nullptr;
+    Mat A_ = nullptr, P_ = nullptr;
+    bool reuse_ = true;
+    bool rebuild_ = true;
+    bool kspStale_ = false;
+    int rebuildEvery_ = 0;
+    int solvesSinceSetup_ = 0;
+    Stats stats_;
+    std::unique_ptr<MixedPrecisionSolver> mixed_;
+};
+
+} // namespace Feel
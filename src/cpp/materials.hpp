@@ -0,0 +1,192 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief material properties parsed once from the json specs
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-04
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <feel/feelcore/json.hpp>
+#include <feel/feelvf/vf.hpp>
+#include <fmt/core.h>
+
+#include "threading.hpp"
+
+namespace Feel
+{
+/**
+ * @brief check if a Feel++ expression string depends on a symbol
+ *
+ * Feel++ expression strings list their symbols after the expression, e.g.
+ * "3*x*t:x:t", an expression without symbol list is a constant.
+ *
+ * @param e expression string
+ * @param symbol name of the symbol
+ * @return true if @p symbol is listed in the symbols of @p e, false otherwise
+ */
+inline bool dependsOn( std::string const& e, std::string const& symbol )
+{
+    std::istringstream istr( e );
+    std::string token;
+    std::getline( istr, token, ':' ); // skip the expression itself
+    while ( std::getline( istr, token, ':' ) )
+        if ( token == symbol )
+            return true;
+    return false;
+}
+
+/**
+ * @brief coefficient parsed once from its json value
+ *
+ * a coefficient without symbols is folded to a double, otherwise the symbolic
+ * expression is built once and kept for the assembly.
+ */
+class Coefficient
+{
+public:
+    using expr_type = std::decay_t<decltype( expr( std::string{} ) )>;
+
+    Coefficient() = default;
+    explicit Coefficient( nl::json const& j )
+    {
+        if ( j.is_number() )
+        {
+            str_ = j.dump();
+            value_ = j.get<double>();
+            return;
+        }
+        str_ = j.get<std::string>();
+        try
+        {
+            std::size_t pos = 0;
+            double v = std::stod( str_, &pos );
+            if ( pos == str_.size() )
+            {
+                value_ = v;
+                return;
+            }
+        }
+        catch ( std::exception const& )
+        {
+        }
+        expr_ = parseExpr( str_ );
+        if ( str_.find( ':' ) == std::string::npos )
+        {
+            // no symbols, e.g. "2*pi", evaluate once
+            value_ = expr_->evaluate()( 0, 0 );
+            expr_.reset();
+        }
+    }
+
+    std::string const& string() const { return str_; }
+    bool isConstant() const { return !expr_.has_value(); }
+    bool dependsOn( std::string const& symbol ) const { return Feel::dependsOn( str_, symbol ); }
+    bool isTimeDependent() const { return dependsOn( "t" ); }
+
+    //! @return the value of a constant coefficient
+    double value() const { return value_; }
+    //! @return the expression of a non constant coefficient
+    expr_type const& expression() const { return *expr_; }
+
+    //! set the value of symbols of a non constant coefficient, e.g. the time t
+    void setParameterValues( std::map<std::string, double> const& mp )
+    {
+        if ( expr_ )
+            expr_->setParameterValues( mp );
+    }
+
+private:
+    std::string str_;
+    double value_ = 0;
+    std::optional<expr_type> expr_;
+};
+
+/**
+ * @brief call @p f with the expression of a coefficient, cst() if it is constant
+ */
+template <typename F>
+void withCoefficient( Coefficient const& a, F&& f )
+{
+    if ( a.isConstant() )
+        f( cst( a.value() ) );
+    else
+        f( a.expression() );
+}
+
+/**
+ * @brief call @p f with the expression of the product of two coefficients
+ *
+ * constant coefficients are passed as cst() so that no symbolic expression is
+ * evaluated for them
+ */
+template <typename F>
+void withProduct( Coefficient const& a, Coefficient const& b, F&& f )
+{
+    if ( a.isConstant() && b.isConstant() )
+        f( cst( a.value() * b.value() ) );
+    else if ( a.isConstant() )
+        f( cst( a.value() ) * b.expression() );
+    else if ( b.isConstant() )
+        f( a.expression() * cst( b.value() ) );
+    else
+        f( a.expression() * b.expression() );
+}
+
+/**
+ * @brief thermal properties of a material
+ */
+struct MaterialProperties
+{
+    std::string name;
+    Coefficient k, rho, Cp;
+
+    bool isConstant() const { return k.isConstant() && rho.isConstant() && Cp.isConstant(); }
+    bool isTimeDependent() const { return k.isTimeDependent() || rho.isTimeDependent() || Cp.isTimeDependent(); }
+    bool isMassTimeDependent() const { return rho.isTimeDependent() || Cp.isTimeDependent(); }
+};
+
+/**
+ * @brief build the material properties of a model from the specs
+ *
+ * @param specs json specs
+ * @param model name of the model in /Models
+ * @return the properties of the materials listed in /Models/<model>/Materials
+ */
+inline std::vector<MaterialProperties> materialProperties( nl::json const& specs, std::string const& model )
+{
+    std::vector<MaterialProperties> props;
+    for ( auto const& [key, material] : specs[nl::json::json_pointer( fmt::format( "/Models/{}/Materials", model ) )].items() )
+    {
+        auto name = material.get<std::string>();
+        auto const& m = specs[nl::json::json_pointer( fmt::format( "/Materials/{}", name ) )];
+        props.push_back( MaterialProperties{ name, Coefficient( m["k"] ), Coefficient( m["rho"] ), Coefficient( m["Cp"] ) } );
+    }
+    return props;
+}
+
+} // namespace Feel
@@ -0,0 +1,582 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief matrix-free grad-grad, mass and Robin operator on affine simplices
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-13
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#if defined( _OPENMP )
+#include <omp.h>
+#endif
+
+#include <Eigen/Dense>
+#include <feel/feelcore/environment.hpp>
+#include <fmt/core.h>
+#include <petscmat.h>
+
+#include "simplexkernels.hpp"
+
+namespace Feel
+{
+/**
+ * @brief operator k grad.grad + rhoCp mass + h Robin mass applied without matrix
+ *
+ * Only the geometric factors of the elements and their dofs are stored, the
+ * element matrices are combinations of the reference matrices of
+ * SimplexKernels. The operator is applied by blocks of elements: the local
+ * values of a block are gathered in a matrix with one column per element and
+ * each reference matrix is applied to the whole block with a dense product,
+ * which vectorizes across the elements.
+ *
+ * The operator is exposed as PETSc shell matrices (MatMult and
+ * MatGetDiagonal) so that the Krylov solvers and the Jacobi preconditioner
+ * work unchanged. The ghost values are exchanged with a VecScatter between the
+ * PETSc layout and the process numbering of the dofs.
+ *
+ * The same element data can also be assembled into a sparse matrix with
+ * threads, see assemble(), or into the sparser matrix of the P1 operator on
+ * the low order refined elements, a cheap preconditioner of the high order
+ * operator, see lowOrderMatrix().
+ */
+template <typename SpaceType>
+class MatrixFreeOperator
+{
+public:
+    static constexpr int Dim = SpaceType::nDim;
+    using space_ptrtype = std::shared_ptr<SpaceType>;
+    using kernels_type = SimplexKernels<Dim>;
+    static constexpr int nPairs = kernels_type::nPairs;
+    //! number of elements per block
+    static constexpr int blockSize = 256;
+
+    /**
+     * @param Xh function space of Lagrange elements on an affine simplex mesh
+     * @param order polynomial order of @p Xh
+     */
+    MatrixFreeOperator( space_ptrtype const& Xh, int order )
+        : Xh_( Xh ),
+          comm_( Xh->worldComm() )
+    {
+        auto const& pts = Xh_->fe()->points();
+        Eigen::MatrixXd nodes( Dim, pts.size2() );
+        for ( std::size_t i = 0; i < pts.size2(); ++i )
+            for ( int d = 0; d < Dim; ++d )
+                nodes( d, i ) = pts( d, i );
+        kernels_ = std::make_unique<kernels_type>( nodes, order );
+        nloc_ = kernels_->nLocalDofs();
+        stiffnessDiagonal_.resize( nloc_, nPairs );
+        for ( int p = 0; p < nPairs; ++p )
+            stiffnessDiagonal_.col( p ) = kernels_->stiffness( p ).diagonal();
+
+        // gather the process dofs, ghosts included, from the PETSc layout
+        auto const& dof = Xh_->dof();
+        std::size_t nprocess = dof->nLocalDofWithGhost();
+        gidx_.resize( nprocess );
+        for ( std::size_t i = 0; i < nprocess; ++i )
+            gidx_[i] = dof->mapGlobalProcessToGlobalCluster( i );
+        nowned_ = dof->nLocalDofWithoutGhost();
+        PetscErrorCode ierr;
+        IS is;
+        ierr = ISCreateGeneral( PETSC_COMM_SELF, nprocess, gidx_.data(), PETSC_COPY_VALUES, &is );
+        CHKERRABORT( comm_, ierr );
+        Vec g;
+        ierr = VecCreateMPI( comm_, nowned_, PETSC_DETERMINE, &g );
+        CHKERRABORT( comm_, ierr );
+        ierr = VecCreateSeq( PETSC_COMM_SELF, nprocess, &xloc_ );
+        CHKERRABORT( comm_, ierr );
+        ierr = VecDuplicate( xloc_, &yloc_ );
+        CHKERRABORT( comm_, ierr );
+        ierr = VecScatterCreate( g, is, xloc_, nullptr, &scatter_ );
+        CHKERRABORT( comm_, ierr );
+        ISDestroy( &is );
+        VecDestroy( &g );
+    }
+    MatrixFreeOperator( MatrixFreeOperator const& ) = delete;
+    MatrixFreeOperator& operator=( MatrixFreeOperator const& ) = delete;
+    ~MatrixFreeOperator()
+    {
+        for ( auto& s : shells_ )
+            MatDestroy( &s.mat );
+        for ( auto& m : lowOrder_ )
+            MatDestroy( &m );
+        VecScatterDestroy( &scatter_ );
+        VecDestroy( &xloc_ );
+        VecDestroy( &yloc_ );
+    }
+
+    /**
+     * @brief add the terms of the elements of @p range
+     *
+     * @param k conductivity
+     * @param rhoCp coefficient of the mass
+     */
+    template <typename RangeType>
+    void addElements( RangeType const& range, double k, double rhoCp )
+    {
+        Eigen::Matrix<double, Dim, Dim + 1> P;
+        Eigen::Matrix<double, nPairs, 1> G;
+        for ( auto const& eltWrap : range )
+        {
+            auto const& elt = unwrap_ref( eltWrap );
+            for ( int v = 0; v <= Dim; ++v )
+                for ( int d = 0; d < Dim; ++d )
+                    P( d, v ) = elt.point( v ).node()[d];
+            double det = kernels_type::geometry( P, G );
+            for ( int i = 0; i < nloc_; ++i )
+                dofs_.push_back( Xh_->dof()->localToGlobal( elt.id(), i, 0 ).index() );
+            for ( int p = 0; p < nPairs; ++p )
+                geometry_.push_back( k * G( p ) );
+            mass_.push_back( rhoCp * det );
+        }
+    }
+
+    /**
+     * @brief add the Robin mass h u v on the faces of @p range
+     */
+    template <typename RangeType>
+    void addRobinFaces( RangeType const& range, double h )
+    {
+        for ( auto const& faceWrap : range )
+        {
+            auto const& face = unwrap_ref( faceWrap );
+            auto const& elt = face.element0();
+            // the face is opposite to the vertex of the element not on the face
+            int opposite = -1;
+            for ( int v = 0; v <= Dim && opposite < 0; ++v )
+            {
+                bool onFace = false;
+                for ( int k = 0; k < Dim; ++k )
+                    onFace = onFace || elt.point( v ).id() == face.point( k ).id();
+                if ( !onFace )
+                    opposite = v;
+            }
+            RobinFace f;
+            f.vertex = opposite;
+            f.factor = h * face.measure() / kernels_->faceMeasure( opposite );
+            for ( int i = 0; i < nloc_; ++i )
+                f.dofs.push_back( Xh_->dof()->localToGlobal( elt.id(), i, 0 ).index() );
+            faces_.push_back( std::move( f ) );
+        }
+    }
+
+    //! @return the number of elements
+    std::size_t nElements() const { return mass_.size(); }
+    //! @return the number of Robin faces
+    std::size_t nFaces() const { return faces_.size(); }
+    //! @return the memory used by the element data in bytes
+    std::size_t memory() const
+    {
+        return dofs_.size() * sizeof( PetscInt ) + ( geometry_.size() + mass_.size() ) * sizeof( double ) +
+               faces_.size() * ( sizeof( RobinFace ) + nloc_ * sizeof( PetscInt ) );
+    }
+
+    /**
+     * @brief shell matrix of stiffness * K + mass * M + robin * R
+     *
+     * the matrix is owned by the operator and valid as long as it lives
+     */
+    Mat shell( double stiffness, double mass, double robin )
+    {
+        shells_.push_back( Shell{ this, stiffness, mass, robin, nullptr } );
+        auto& s = shells_.back();
+        PetscErrorCode ierr = MatCreateShell( comm_, nowned_, nowned_, PETSC_DETERMINE, PETSC_DETERMINE, &s, &s.mat );
+        CHKERRABORT( comm_, ierr );
+        ierr = MatShellSetOperation( s.mat, MATOP_MULT, (void ( * )( void )) & MatrixFreeOperator::shellMult );
+        CHKERRABORT( comm_, ierr );
+        ierr = MatShellSetOperation( s.mat, MATOP_GET_DIAGONAL, (void ( * )( void )) & MatrixFreeOperator::shellDiagonal );
+        CHKERRABORT( comm_, ierr );
+        ierr = MatSetOption( s.mat, MAT_SYMMETRIC, PETSC_TRUE );
+        CHKERRABORT( comm_, ierr );
+        return s.mat;
+    }
+
+    //! change the factors of a matrix returned by shell()
+    void setScaling( Mat A, double stiffness, double mass, double robin )
+    {
+        Shell* s;
+        PetscErrorCode ierr = MatShellGetContext( A, &s );
+        CHKERRABORT( comm_, ierr );
+        s->stiffness = stiffness;
+        s->mass = mass;
+        s->robin = robin;
+        ierr = PetscObjectStateIncrease( (PetscObject)A );
+        CHKERRABORT( comm_, ierr );
+    }
+
+    /**
+     * @brief add stiffness * K + mass * M + robin * R to the sparse matrix @p A
+     *
+     * The element matrices are computed by @p nthreads threads. The rows of the
+     * process are then split between the threads: each thread merges the
+     * contributions of the elements to its rows into a buffer of its own, and
+     * the buffers are added to @p A one row at a time. The result does not
+     * depend on the number of threads. @p A must have the sparsity of the
+     * element couplings, it is assembled on return.
+     */
+    void assemble( Mat A, double stiffness, double mass, double robin, int nthreads ) const
+    {
+        setRows( A, rowBuffers( *kernels_, stiffness, mass, robin, nthreads, false ) );
+    }
+
+    /**
+     * @brief sparse matrix of stiffness * K + mass * M + robin * R in P1 on the low order refined elements
+     *
+     * the nodes of each element split it into order^Dim simplices, see
+     * SimplexKernels::lowOrderRefined(). The matrix has the dofs of the
+     * operator and only the couplings of the sub-simplices, it is
+     * preallocated exactly. It is owned by the operator and valid as long as
+     * it lives.
+     */
+    Mat lowOrderMatrix( double stiffness, double mass, double robin, int nthreads )
+    {
+        auto buffers = rowBuffers( lowOrderKernels(), stiffness, mass, robin, nthreads, true );
+        PetscErrorCode ierr;
+        Mat pattern, A;
+        ierr = MatCreate( comm_, &pattern );
+        CHKERRABORT( comm_, ierr );
+        ierr = MatSetSizes( pattern, nowned_, nowned_, PETSC_DETERMINE, PETSC_DETERMINE );
+        CHKERRABORT( comm_, ierr );
+        ierr = MatSetType( pattern, MATPREALLOCATOR );
+        CHKERRABORT( comm_, ierr );
+        ierr = MatSetUp( pattern );
+        CHKERRABORT( comm_, ierr );
+        setRows( pattern, buffers );
+        ierr = MatCreate( comm_, &A );
+        CHKERRABORT( comm_, ierr );
+        ierr = MatSetSizes( A, nowned_, nowned_, PETSC_DETERMINE, PETSC_DETERMINE );
+        CHKERRABORT( comm_, ierr );
+        ierr = MatSetType( A, MATAIJ );
+        CHKERRABORT( comm_, ierr );
+        ierr = MatPreallocatorPreallocate( pattern, PETSC_TRUE, A );
+        CHKERRABORT( comm_, ierr );
+        MatDestroy( &pattern );
+        setRows( A, buffers );
+        ierr = MatSetOption( A, MAT_SYMMETRIC, PETSC_TRUE );
+        CHKERRABORT( comm_, ierr );
+        lowOrder_.push_back( A );
+        return A;
+    }
+
+    //! assemble again a matrix returned by lowOrderMatrix() with other factors
+    void assembleLowOrder( Mat A, double stiffness, double mass, double robin, int nthreads )
+    {
+        PetscErrorCode ierr = MatZeroEntries( A );
+        CHKERRABORT( comm_, ierr );
+        setRows( A, rowBuffers( lowOrderKernels(), stiffness, mass, robin, nthreads, true ) );
+    }
+
+    //! y = (stiffness * K + mass * M + robin * R) x
+    void apply( Vec x, Vec y, double stiffness, double mass, double robin ) const
+    {
+        PetscErrorCode ierr = VecScatterBegin( scatter_, x, xloc_, INSERT_VALUES, SCATTER_FORWARD );
+        CHKERRABORT( comm_, ierr );
+        ierr = VecScatterEnd( scatter_, x, xloc_, INSERT_VALUES, SCATTER_FORWARD );
+        CHKERRABORT( comm_, ierr );
+        ierr = VecSet( yloc_, 0 );
+        CHKERRABORT( comm_, ierr );
+        PetscScalar const* xa;
+        PetscScalar* ya;
+        VecGetArrayRead( xloc_, &xa );
+        VecGetArray( yloc_, &ya );
+
+        Eigen::MatrixXd X( nloc_, blockSize ), Y( nloc_, blockSize ), KX( nloc_, blockSize );
+        std::size_t ne = nElements();
+        for ( std::size_t e0 = 0; e0 < ne; e0 += blockSize )
+        {
+            int nb = static_cast<int>( std::min<std::size_t>( blockSize, ne - e0 ) );
+            Eigen::Map<Eigen::Matrix<PetscInt, Eigen::Dynamic, Eigen::Dynamic> const> D( dofs_.data() + e0 * nloc_, nloc_, nb );
+            Eigen::Map<Eigen::MatrixXd const> G( geometry_.data() + e0 * nPairs, nPairs, nb );
+            Eigen::Map<Eigen::RowVectorXd const> m( mass_.data() + e0, nb );
+            auto Xb = X.leftCols( nb );
+            auto Yb = Y.leftCols( nb );
+            auto KXb = KX.leftCols( nb );
+            for ( int c = 0; c < nb; ++c )
+                for ( int i = 0; i < nloc_; ++i )
+                    Xb( i, c ) = xa[D( i, c )];
+            Yb.setZero();
+            if ( stiffness != 0 )
+                for ( int p = 0; p < nPairs; ++p )
+                {
+                    KXb.noalias() = kernels_->stiffness( p ) * Xb;
+                    Yb.array() += KXb.array().rowwise() * ( stiffness * G.row( p ) ).array();
+                }
+            if ( mass != 0 )
+            {
+                KXb.noalias() = kernels_->mass() * Xb;
+                Yb.array() += KXb.array().rowwise() * ( mass * m ).array();
+            }
+            for ( int c = 0; c < nb; ++c )
+                for ( int i = 0; i < nloc_; ++i )
+                    ya[D( i, c )] += Yb( i, c );
+        }
+        if ( robin != 0 )
+        {
+            Eigen::VectorXd xf( nloc_ ), yf( nloc_ );
+            for ( auto const& f : faces_ )
+            {
+                for ( int i = 0; i < nloc_; ++i )
+                    xf( i ) = xa[f.dofs[i]];
+                yf.noalias() = ( robin * f.factor ) * ( kernels_->faceMass( f.vertex ) * xf );
+                for ( int i = 0; i < nloc_; ++i )
+                    ya[f.dofs[i]] += yf( i );
+            }
+        }
+        VecRestoreArrayRead( xloc_, &xa );
+        VecRestoreArray( yloc_, &ya );
+        accumulate( y );
+    }
+
+    //! diagonal of stiffness * K + mass * M + robin * R
+    void diagonal( Vec d, double stiffness, double mass, double robin ) const
+    {
+        PetscErrorCode ierr = VecSet( yloc_, 0 );
+        CHKERRABORT( comm_, ierr );
+        PetscScalar* ya;
+        VecGetArray( yloc_, &ya );
+        std::size_t ne = nElements();
+        Eigen::VectorXd md = kernels_->mass().diagonal();
+        for ( std::size_t e0 = 0; e0 < ne; e0 += blockSize )
+        {
+            int nb = static_cast<int>( std::min<std::size_t>( blockSize, ne - e0 ) );
+            Eigen::Map<Eigen::Matrix<PetscInt, Eigen::Dynamic, Eigen::Dynamic> const> D( dofs_.data() + e0 * nloc_, nloc_, nb );
+            Eigen::Map<Eigen::MatrixXd const> G( geometry_.data() + e0 * nPairs, nPairs, nb );
+            Eigen::Map<Eigen::RowVectorXd const> m( mass_.data() + e0, nb );
+            Eigen::MatrixXd Db = stiffness * ( stiffnessDiagonal_ * G ) + mass * md * m;
+            for ( int c = 0; c < nb; ++c )
+                for ( int i = 0; i < nloc_; ++i )
+                    ya[D( i, c )] += Db( i, c );
+        }
+        if ( robin != 0 )
+            for ( auto const& f : faces_ )
+                for ( int i = 0; i < nloc_; ++i )
+                    ya[f.dofs[i]] += robin * f.factor * kernels_->faceMass( f.vertex )( i, i );
+        VecRestoreArray( yloc_, &ya );
+        accumulate( d );
+    }
+
+private:
+    //! rows of the process, one buffer per thread, of the values merged by row
+    struct RowBuffer
+    {
+        std::vector<std::size_t> rows, offsets{ 0 };
+        std::vector<PetscInt> cols;
+        std::vector<PetscScalar> values;
+    };
+
+    /**
+     * @brief merge by row the element matrices of @p kernels computed by @p nthreads threads
+     *
+     * @param skipZeros drop the zero entries of the element matrices, e.g. the
+     * uncoupled dofs of the low order refined elements
+     */
+    std::vector<RowBuffer> rowBuffers( kernels_type const& kernels, double stiffness, double mass, double robin, int nthreads, bool skipZeros ) const
+    {
+        std::size_t ne = ( stiffness != 0 || mass != 0 ) ? nElements() : 0;
+        std::size_t nf = robin != 0 ? faces_.size() : 0;
+        long nitems = static_cast<long>( ne + nf );
+        int n2 = nloc_ * nloc_;
+        auto itemDofs = [&]( long e ) { return e < static_cast<long>( ne ) ? dofs_.data() + e * nloc_ : faces_[e - ne].dofs.data(); };
+        int nt = 1;
+#if defined( _OPENMP )
+        nt = std::max( 1, nthreads );
+#endif
+
+        std::vector<double> Ke( nitems * n2 );
+#pragma omp parallel for num_threads( nt ) schedule( static )
+        for ( long e = 0; e < nitems; ++e )
+        {
+            Eigen::Map<Eigen::MatrixXd> K( Ke.data() + e * n2, nloc_, nloc_ );
+            if ( e < static_cast<long>( ne ) )
+            {
+                K = ( mass * mass_[e] ) * kernels.mass();
+                for ( int p = 0; p < nPairs; ++p )
+                    K += ( stiffness * geometry_[e * nPairs + p] ) * kernels.stiffness( p );
+            }
+            else
+            {
+                auto const& f = faces_[e - ne];
+                K = ( robin * f.factor ) * kernels.faceMass( f.vertex );
+            }
+        }
+
+        // contributions (item, local row) of each process row
+        std::size_t nrows = gidx_.size();
+        std::vector<std::size_t> start( nrows + 1, 0 );
+        for ( long e = 0; e < nitems; ++e )
+            for ( int i = 0; i < nloc_; ++i )
+                ++start[itemDofs( e )[i] + 1];
+        std::partial_sum( start.begin(), start.end(), start.begin() );
+        std::vector<std::pair<long, int>> contrib( start.back() );
+        {
+            std::vector<std::size_t> pos( start.begin(), start.end() - 1 );
+            for ( long e = 0; e < nitems; ++e )
+                for ( int i = 0; i < nloc_; ++i )
+                    contrib[pos[itemDofs( e )[i]]++] = { e, i };
+        }
+
+        std::vector<RowBuffer> buffers( nt );
+#pragma omp parallel num_threads( nt )
+        {
+            int t = 0;
+#if defined( _OPENMP )
+            t = omp_get_thread_num();
+#endif
+            auto& b = buffers[t];
+            std::vector<std::pair<PetscInt, PetscScalar>> row;
+            for ( std::size_t r = nrows * t / nt; r < nrows * ( t + 1 ) / nt; ++r )
+            {
+                if ( start[r] == start[r + 1] )
+                    continue;
+                row.clear();
+                for ( std::size_t c = start[r]; c < start[r + 1]; ++c )
+                {
+                    auto [e, i] = contrib[c];
+                    PetscInt const* d = itemDofs( e );
+                    double const* K = Ke.data() + e * n2;
+                    for ( int j = 0; j < nloc_; ++j )
+                        if ( !skipZeros || K[j * nloc_ + i] != 0 )
+                            row.emplace_back( d[j], K[j * nloc_ + i] );
+                }
+                std::sort( row.begin(), row.end(), []( auto const& x, auto const& y ) { return x.first < y.first; } );
+                b.rows.push_back( r );
+                for ( std::size_t k = 0; k < row.size(); ++k )
+                {
+                    if ( k > 0 && row[k].first == row[k - 1].first )
+                    {
+                        b.values.back() += row[k].second;
+                        continue;
+                    }
+                    b.cols.push_back( gidx_[row[k].first] );
+                    b.values.push_back( row[k].second );
+                }
+                b.offsets.push_back( b.cols.size() );
+            }
+        }
+
+        return buffers;
+    }
+
+    //! add the rows of @p buffers to @p A and assemble it
+    void setRows( Mat A, std::vector<RowBuffer> const& buffers ) const
+    {
+        PetscErrorCode ierr;
+        for ( auto const& b : buffers )
+            for ( std::size_t k = 0; k < b.rows.size(); ++k )
+            {
+                PetscInt row = gidx_[b.rows[k]];
+                ierr = MatSetValues( A, 1, &row, static_cast<PetscInt>( b.offsets[k + 1] - b.offsets[k] ),
+                                     b.cols.data() + b.offsets[k], b.values.data() + b.offsets[k], ADD_VALUES );
+                CHKERRABORT( comm_, ierr );
+            }
+        ierr = MatAssemblyBegin( A, MAT_FINAL_ASSEMBLY );
+        CHKERRABORT( comm_, ierr );
+        ierr = MatAssemblyEnd( A, MAT_FINAL_ASSEMBLY );
+        CHKERRABORT( comm_, ierr );
+    }
+
+
+    kernels_type const& lowOrderKernels()
+    {
+        if ( !lowKernels_ )
+        {
+            auto const& pts = Xh_->fe()->points();
+            Eigen::MatrixXd nodes( Dim, pts.size2() );
+            for ( std::size_t i = 0; i < pts.size2(); ++i )
+                for ( int d = 0; d < Dim; ++d )
+                    nodes( d, i ) = pts( d, i );
+            lowKernels_ = std::make_unique<kernels_type>( kernels_->lowOrderRefined( nodes ) );
+        }
+        return *lowKernels_;
+    }
+
+    struct Shell
+    {
+        MatrixFreeOperator const* op;
+        double stiffness, mass, robin;
+        Mat mat;
+    };
+    struct RobinFace
+    {
+        int vertex;
+        double factor;
+        std::vector<PetscInt> dofs;
+    };
+
+    //! sum the process contributions, ghosts included, into @p y
+    void accumulate( Vec y ) const
+    {
+        PetscErrorCode ierr = VecSet( y, 0 );
+        CHKERRABORT( comm_, ierr );
+        ierr = VecScatterBegin( scatter_, yloc_, y, ADD_VALUES, SCATTER_REVERSE );
+        CHKERRABORT( comm_, ierr );
+        ierr = VecScatterEnd( scatter_, yloc_, y, ADD_VALUES, SCATTER_REVERSE );
+        CHKERRABORT( comm_, ierr );
+    }
+
+    static PetscErrorCode shellMult( Mat A, Vec x, Vec y )
+    {
+        Shell* s;
+        PetscErrorCode ierr = MatShellGetContext( A, &s );
+        if ( ierr )
+            return ierr;
+        s->op->apply( x, y, s->stiffness, s->mass, s->robin );
+        return 0;
+    }
+    static PetscErrorCode shellDiagonal( Mat A, Vec d )
+    {
+        Shell* s;
+        PetscErrorCode ierr = MatShellGetContext( A, &s );
+        if ( ierr )
+            return ierr;
+        s->op->diagonal( d, s->stiffness, s->mass, s->robin );
+        return 0;
+    }
+
+    space_ptrtype Xh_;
+    MPI_Comm comm_;
+    std::unique_ptr<kernels_type> kernels_, lowKernels_;
+    int nloc_ = 0;
+    PetscInt nowned_ = 0;
+    Eigen::Matrix<double, Eigen::Dynamic, nPairs> stiffnessDiagonal_;
+    // global index of the process dofs
+    std::vector<PetscInt> gidx_;
+
+    // element data: dofs in the process numbering, stiffness factors scaled by k, mass factors scaled by rhoCp
+    std::vector<PetscInt> dofs_;
+    std::vector<double> geometry_, mass_;
+    std::vector<RobinFace> faces_;
+
+    VecScatter scatter_ = nullptr;
+    Vec xloc_ = nullptr, yloc_ = nullptr;
+    // stable addresses for the shell contexts
+    std::list<Shell> shells_;
+    std::vector<Mat> lowOrder_;
+};
+
+} // namespace Feel
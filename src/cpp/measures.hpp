@@ -0,0 +1,342 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief columnar store of the time series of measures
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-06
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <feel/feelcore/json.hpp>
+#include <fmt/core.h>
+
+namespace Feel
+{
+/**
+ * @brief time series of measures stored as columns of doubles
+ *
+ * Each measure is a column, a row is appended at each exported time step.
+ * The rows can be streamed to a file every @c flushEvery rows:
+ * - csv: a header line with the column names followed by one line per row
+ * - binary: the magic string "FPMEAS1\n", the number of columns as int64 and
+ *   the zero terminated column names, followed by chunks made of the number
+ *   of rows as int64 and then the values of each column in turn
+ *
+ * If the rows are not kept in memory, flushed rows are dropped and the memory
+ * does not grow with the number of time steps.
+ */
+class MeasuresStore
+{
+public:
+    enum class Format
+    {
+        None,
+        Csv,
+        Binary
+    };
+
+    MeasuresStore() = default;
+
+    /**
+     * @brief configure the streaming from /PostProcess/<model>/Measures
+     *
+     * "filename", "format" ("csv" or "binary", deduced from the extension
+     * otherwise), "flush_every" and "keep_in_memory"
+     *
+     * @param writer true on the rank writing the file
+     * @param append true to append the rows to an existing file, e.g. on restart
+     */
+    void setOutput( nl::json const& j, bool writer, bool append = false )
+    {
+        filename_ = j.value( "filename", std::string{} );
+        auto f = j.value( "format", filename_.size() > 4 && filename_.substr( filename_.size() - 4 ) == ".csv" ? "csv" : "binary" );
+        format_ = filename_.empty() ? Format::None : ( f == "csv" ? Format::Csv : Format::Binary );
+        flushEvery_ = std::max( 1, j.value( "flush_every", 100 ) );
+        keep_ = j.value( "keep_in_memory", true );
+        writer_ = writer;
+        append_ = append && std::filesystem::exists( filename_ );
+        headerWritten_ = false;
+        flushed_ = 0;
+    }
+
+    //! preallocate @p rows rows in every column, at most a chunk if the flushed rows are dropped
+    void reserve( std::size_t rows )
+    {
+        if ( format_ != Format::None && !keep_ )
+            rows = std::min( rows, static_cast<std::size_t>( flushEvery_ ) );
+        capacity_ = rows;
+        for ( auto& c : columns_ )
+            c.reserve( rows );
+    }
+
+    //! @return the index of column @p name, created if needed and filled with NaN for the previous rows
+    int column( std::string const& name )
+    {
+        if ( auto it = index_.find( name ); it != index_.end() )
+            return it->second;
+        if ( headerWritten_ )
+            throw std::logic_error( fmt::format( "measure {} added after the output header was written", name ) );
+        index_[name] = static_cast<int>( names_.size() );
+        names_.push_back( name );
+        columns_.emplace_back();
+        columns_.back().reserve( capacity_ );
+        columns_.back().resize( rows(), std::numeric_limits<double>::quiet_NaN() );
+        return index_[name];
+    }
+
+    //! set @p value in column @p c of the current row
+    void set( int c, double value )
+    {
+        row_.resize( names_.size(), std::numeric_limits<double>::quiet_NaN() );
+        row_[c] = value;
+    }
+    void set( std::string const& name, double value ) { set( column( name ), value ); }
+
+    //! append the current row to the columns and flush if needed
+    void commit()
+    {
+        row_.resize( names_.size(), std::numeric_limits<double>::quiet_NaN() );
+        for ( std::size_t c = 0; c < columns_.size(); ++c )
+            columns_[c].push_back( row_[c] );
+        row_.assign( names_.size(), std::numeric_limits<double>::quiet_NaN() );
+        if ( format_ != Format::None && rows() - flushed_ >= static_cast<std::size_t>( flushEvery_ ) )
+            flush();
+    }
+
+    //! write the rows not yet streamed to the output file
+    void flush()
+    {
+        if ( format_ == Format::None || rows() == flushed_ )
+            return;
+        if ( writer_ )
+        {
+            // the header of an appended file is the one of the previous run
+            bool skipHeader = headerWritten_ || append_;
+            std::ofstream out( filename_, skipHeader ? std::ios::app | std::ios::binary : std::ios::trunc | std::ios::binary );
+            if ( !out )
+                throw std::runtime_error( fmt::format( "Unable to open file: {}", filename_ ) );
+            if ( format_ == Format::Csv )
+                writeCsv( out, skipHeader, flushed_ );
+            else
+                writeBinary( out, skipHeader, flushed_ );
+        }
+        headerWritten_ = true;
+        if ( keep_ )
+            flushed_ = rows();
+        else
+        {
+            // release the memory of columns grown before the output was set
+            for ( auto& c : columns_ )
+            {
+                c.clear();
+                if ( c.capacity() > std::max<std::size_t>( capacity_, flushEvery_ ) )
+                {
+                    c.shrink_to_fit();
+                    c.reserve( capacity_ );
+                }
+            }
+            flushed_ = 0;
+        }
+    }
+
+    std::size_t rows() const { return columns_.empty() ? 0 : columns_.front().size(); }
+    std::vector<std::string> const& names() const { return names_; }
+    std::vector<double> const& values( std::string const& name ) const { return columns_.at( index_.at( name ) ); }
+    bool contains( std::string const& name ) const { return index_.count( name ) > 0; }
+
+    //! remove all rows and columns
+    void clear()
+    {
+        names_.clear();
+        index_.clear();
+        columns_.clear();
+        row_.clear();
+        flushed_ = 0;
+        headerWritten_ = false;
+    }
+
+    //! json view of the rows in memory, one array per measure
+    nl::json toJson() const
+    {
+        nl::json j = nl::json::object();
+        for ( std::size_t c = 0; c < columns_.size(); ++c )
+            j[names_[c]] = columns_[c];
+        return j;
+    }
+
+    //! write all the rows in memory in csv format
+    void writeCsv( std::ostream& out, bool skipHeader = false, std::size_t from = 0 ) const
+    {
+        if ( !skipHeader )
+        {
+            for ( std::size_t c = 0; c < names_.size(); ++c )
+                out << ( c ? "," : "" ) << names_[c];
+            out << "\n";
+        }
+        for ( std::size_t r = from; r < rows(); ++r )
+        {
+            for ( std::size_t c = 0; c < columns_.size(); ++c )
+                out << ( c ? "," : "" ) << fmt::format( "{:.16g}", columns_[c][r] );
+            out << "\n";
+        }
+    }
+
+    //! write all the rows in memory in binary columnar format
+    void writeBinary( std::ostream& out, bool skipHeader = false, std::size_t from = 0 ) const
+    {
+        if ( !skipHeader )
+        {
+            out.write( "FPMEAS1\n", 8 );
+            std::int64_t n = names_.size();
+            out.write( reinterpret_cast<char const*>( &n ), sizeof( n ) );
+            for ( auto const& name : names_ )
+                out.write( name.c_str(), name.size() + 1 );
+        }
+        std::int64_t nrows = rows() - from;
+        out.write( reinterpret_cast<char const*>( &nrows ), sizeof( nrows ) );
+        for ( auto const& c : columns_ )
+            out.write( reinterpret_cast<char const*>( c.data() + from ), nrows * sizeof( double ) );
+    }
+
+    /**
+     * @brief read a file written by the streaming, writeCsv() or writeBinary()
+     *
+     * @param filename csv file, or binary file starting with "FPMEAS1\n"
+     */
+    static MeasuresStore read( std::string const& filename )
+    {
+        std::ifstream in( filename, std::ios::binary );
+        if ( !in )
+            throw std::runtime_error( fmt::format( "Unable to open file: {}", filename ) );
+        MeasuresStore s;
+        char magic[8] = {};
+        in.read( magic, 8 );
+        if ( in && std::string( magic, 8 ) == "FPMEAS1\n" )
+        {
+            std::int64_t n = 0;
+            in.read( reinterpret_cast<char*>( &n ), sizeof( n ) );
+            for ( std::int64_t c = 0; c < n; ++c )
+            {
+                std::string name;
+                std::getline( in, name, '\0' );
+                s.column( name );
+            }
+            std::int64_t nrows = 0;
+            while ( in.read( reinterpret_cast<char*>( &nrows ), sizeof( nrows ) ) )
+                for ( auto& c : s.columns_ )
+                {
+                    auto size = c.size();
+                    c.resize( size + nrows );
+                    if ( !in.read( reinterpret_cast<char*>( c.data() + size ), nrows * sizeof( double ) ) )
+                        throw std::runtime_error( fmt::format( "{}: truncated chunk", filename ) );
+                }
+            return s;
+        }
+        in.clear();
+        in.seekg( 0 );
+        auto split = []( std::string const& line ) {
+            std::vector<std::string> fields;
+            std::istringstream istr( line );
+            for ( std::string f; std::getline( istr, f, ',' ); )
+                fields.push_back( f );
+            return fields;
+        };
+        std::string line;
+        if ( !std::getline( in, line ) )
+            throw std::runtime_error( fmt::format( "{}: no header", filename ) );
+        for ( auto const& name : split( line ) )
+            s.column( name );
+        while ( std::getline( in, line ) )
+        {
+            auto fields = split( line );
+            if ( fields.size() != s.names_.size() )
+                throw std::runtime_error( fmt::format( "{}: {} values in a row of {} columns", filename, fields.size(), s.names_.size() ) );
+            for ( std::size_t c = 0; c < fields.size(); ++c )
+                s.set( c, std::stod( fields[c] ) );
+            s.commit();
+        }
+        return s;
+    }
+
+private:
+    std::vector<std::string> names_;
+    std::map<std::string, int> index_;
+    std::vector<std::vector<double>> columns_;
+    std::vector<double> row_;
+    std::size_t capacity_ = 0;
+
+    std::string filename_;
+    Format format_ = Format::None;
+    int flushEvery_ = 100;
+    bool keep_ = true;
+    bool writer_ = false;
+    bool headerWritten_ = false;
+    bool append_ = false;
+    std::size_t flushed_ = 0;
+};
+
+/**
+ * @brief check the measures of a run against the ones of a reference run
+ *
+ * every row of @p run must have a row at the same time in @p reference,
+ * the columns of both stores must then agree within @p rtol and @p atol
+ *
+ * @return the number of compared rows
+ * @throw std::runtime_error on the first mismatch
+ */
+inline std::size_t compareMeasures( MeasuresStore const& run, MeasuresStore const& reference, double rtol, double atol )
+{
+    if ( !run.contains( "time" ) || !reference.contains( "time" ) )
+        throw std::runtime_error( "measures comparison: no time column" );
+    auto const& t = run.values( "time" );
+    auto const& tref = reference.values( "time" );
+    for ( std::size_t r = 0; r < t.size(); ++r )
+    {
+        auto it = std::find_if( tref.begin(), tref.end(), [&]( double s ) { return std::abs( s - t[r] ) <= 1e-9 * std::max( 1., std::abs( t[r] ) ); } );
+        if ( it == tref.end() )
+            throw std::runtime_error( fmt::format( "measures comparison: no reference row at t={}", t[r] ) );
+        auto rref = static_cast<std::size_t>( it - tref.begin() );
+        for ( auto const& name : run.names() )
+        {
+            if ( !reference.contains( name ) )
+                continue;
+            double a = run.values( name )[r], b = reference.values( name )[rref];
+            if ( std::isnan( a ) && std::isnan( b ) )
+                continue;
+            if ( !( std::abs( a - b ) <= atol + rtol * std::max( std::abs( a ), std::abs( b ) ) ) )
+                throw std::runtime_error( fmt::format( "measures comparison: {} at t={} is {} instead of {}", name, t[r], a, b ) );
+        }
+    }
+    return t.size();
+}
+
+} // namespace Feel
@@ -0,0 +1,404 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief adaptive mesh refinement loop driven by a residual error indicator
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-25
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <feel/feelcore/environment.hpp>
+#include <feel/feelcore/json.hpp>
+#include <fmt/core.h>
+
+#include "laplacian.hpp"
+#include "meshcache.hpp"
+
+namespace Feel
+{
+/**
+ * @brief options of the mesh adaptation read from /Adaptivity/<model>
+ *
+ * true or an object enables the adaptation:
+ * - "theta": fraction of the squared estimate held by the marked elements
+ * - "refinement": size factor of the marked elements
+ * - "coarsening": size factor of the other elements
+ * - "hmin", "hmax": bounds of the element sizes
+ * - "measures": prefixes of the measures of interest
+ * - "tolerance": relative change of the measures of interest between two
+ *   meshes below which the adaptation stops
+ * - "estimate": the adaptation also stops once the estimate is below it
+ * - "max_iterations", "max_dofs": bounds of the adaptation
+ * - "window": duration of the time windows of a transient run, 0 for one
+ *   window over the time interval
+ * - "directory": directory of the generated geometries and size fields
+ * - "filename": json file of the history of the adaptation
+ */
+struct AdaptationOptions
+{
+    bool enabled = false;
+    double theta = 0.5;
+    double refinement = 0.5;
+    double coarsening = 1;
+    double hmin = 0;
+    double hmax = std::numeric_limits<double>::max();
+    std::vector<std::string> measures{ "flux_", "mean_" };
+    double tolerance = 1e-3;
+    double estimate = 0;
+    int maxIterations = 8;
+    std::size_t maxDofs = 0;
+    double window = 0;
+    std::string directory = "adaptation";
+    std::string filename;
+
+    AdaptationOptions() = default;
+    explicit AdaptationOptions( nl::json const& j )
+    {
+        if ( j.is_boolean() )
+            enabled = j.get<bool>();
+        else if ( j.is_object() )
+        {
+            enabled = j.value( "enabled", true );
+            theta = std::clamp( j.value( "theta", theta ), 0., 1. );
+            refinement = j.value( "refinement", refinement );
+            coarsening = j.value( "coarsening", coarsening );
+            hmin = j.value( "hmin", hmin );
+            hmax = j.value( "hmax", hmax );
+            measures = j.value( "measures", measures );
+            tolerance = j.value( "tolerance", tolerance );
+            estimate = j.value( "estimate", estimate );
+            maxIterations = std::max( 1, j.value( "max_iterations", maxIterations ) );
+            maxDofs = j.value( "max_dofs", maxDofs );
+            window = j.value( "window", window );
+            directory = j.value( "directory", directory );
+            filename = j.value( "filename", filename );
+        }
+    }
+};
+
+/**
+ * @brief Dörfler marking: threshold of the indicators of the elements to refine, collective
+ *
+ * the elements whose indicator is at least the threshold hold at least
+ * @p theta of the sum of the indicators over all the ranks
+ *
+ * @param eta2 squared indicators of the elements of the process
+ * @return the largest such threshold
+ */
+inline double dorflerThreshold( std::vector<double> eta2, double theta, MPI_Comm comm )
+{
+    std::sort( eta2.begin(), eta2.end(), std::greater<>() );
+    // sums of the largest indicators
+    std::vector<double> sums( eta2.size() + 1, 0. );
+    for ( std::size_t i = 0; i < eta2.size(); ++i )
+        sums[i + 1] = sums[i] + eta2[i];
+    auto above = [&]( double t ) {
+        // the elements equal to t are included
+        double s = sums[std::upper_bound( eta2.begin(), eta2.end(), t, std::greater<>() ) - eta2.begin()];
+        MPI_Allreduce( MPI_IN_PLACE, &s, 1, MPI_DOUBLE, MPI_SUM, comm );
+        return s;
+    };
+    double total = sums.back(), hi = eta2.empty() ? 0. : eta2.front();
+    MPI_Allreduce( MPI_IN_PLACE, &total, 1, MPI_DOUBLE, MPI_SUM, comm );
+    MPI_Allreduce( MPI_IN_PLACE, &hi, 1, MPI_DOUBLE, MPI_MAX, comm );
+    double lo = 0;
+    if ( total <= 0 )
+        return std::numeric_limits<double>::max();
+    if ( above( hi ) >= theta * total )
+        return hi;
+    for ( int i = 0; i < 64 && lo < hi; ++i )
+    {
+        double mid = 0.5 * ( lo + hi );
+        if ( above( mid ) >= theta * total )
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * @brief write the element sizes of the elements of the process as a gmsh view
+ *
+ * @param size function returning the size of an element
+ */
+template <typename MeshType, typename SizeFunction>
+void writeSizeField( std::shared_ptr<MeshType> const& mesh, std::string const& filename, SizeFunction&& size )
+{
+    constexpr int dim = MeshType::nDim;
+    std::ofstream out( filename );
+    out.precision( 17 );
+    out << "View \"size\" {\n";
+    for ( auto const& eltWrap : elements( mesh ) )
+    {
+        auto const& elt = unwrap_ref( eltWrap );
+        out << ( dim == 2 ? "ST(" : "SS(" );
+        for ( int i = 0; i <= dim; ++i )
+            for ( int c = 0; c < 3; ++c )
+                out << ( i + c > 0 ? "," : "" ) << ( c < MeshType::nRealDim ? elt.point( i ).node()[c] : 0. );
+        double h = size( elt );
+        out << "){";
+        for ( int i = 0; i <= dim; ++i )
+            out << ( i > 0 ? "," : "" ) << h;
+        out << "};\n";
+    }
+    out << "};\n";
+}
+
+/**
+ * @brief geometry @p geo meshed with the sizes of gmsh views
+ *
+ * the description of @p geo is copied, so that the gmsh variables of the
+ * options still apply, and the views are merged into a background field which
+ * replaces the sizes of the points
+ */
+inline void writeAdaptedGeometry( std::string const& geo, std::vector<std::string> const& views, std::string const& filename )
+{
+    std::ifstream in( geo );
+    if ( !in )
+        throw std::runtime_error( fmt::format( "mesh adaptation: cannot read the geometry {}", geo ) );
+    std::ostringstream desc;
+    desc << in.rdbuf();
+    std::ofstream out( filename );
+    out << desc.str() << "\n// element sizes of the adapted mesh\n";
+    for ( auto const& v : views )
+        out << fmt::format( "Merge \"{}\";\n", v );
+    if ( views.size() > 1 )
+        out << "Combine ElementsFromAllViews;\n";
+    out << "Field[9999] = PostView;\n"
+        << "Field[9999].ViewIndex = 0;\n"
+        << "Background Field = 9999;\n"
+        << "Mesh.CharacteristicLengthFromPoints = 0;\n"
+        << "Mesh.CharacteristicLengthFromCurvature = 0;\n"
+        << "Mesh.CharacteristicLengthExtendFromBoundary = 0;\n";
+}
+
+/**
+ * @brief adaptive loop around Laplacian::run()
+ *
+ * each iteration solves, computes the residual indicator of the final state,
+ * see Laplacian::errorIndicator(), marks the elements with the Dörfler
+ * strategy and meshes the geometry again with smaller elements where they
+ * are marked. It stops when the measures of interest, e.g. flux_Gamma_root,
+ * change less than the tolerance from one mesh to the next.
+ *
+ * A transient run is adapted by time windows. The iterations of a window
+ * start from the state at the beginning of the window, u and the history of
+ * the time scheme, interpolated on the new mesh, and the next window starts
+ * from the final state of the last iteration. The fields of a window are
+ * exported under the name of the exporter suffixed by -amr<window>.
+ *
+ * The mesh must be imported from a .geo file and the domain must be the
+ * whole mesh.
+ */
+template <int Dim, int Order>
+class MeshAdaptation
+{
+public:
+    using laplacian_type = Laplacian<Dim, Order>;
+    using mesh_t = typename laplacian_type::mesh_t;
+    using p0_element_t = typename laplacian_type::p0_element_t;
+
+    explicit MeshAdaptation( laplacian_type& l )
+        : l_( l ),
+          options_( get_value( l.specs(), "/Adaptivity/laplacian", nl::json::object() ) )
+    {
+    }
+
+    AdaptationOptions const& options() const { return options_; }
+    //! one entry per solve: window, iteration, time, elements, dofs, estimate and measures of interest
+    nl::json const& history() const { return history_; }
+
+    void run()
+    {
+        nl::json specs = l_.specs();
+        if ( specs.contains( "/Spaces/laplacian/Domain/marker"_json_pointer ) || specs.contains( "/Spaces/laplacian/Domain/levelset"_json_pointer ) )
+            throw std::invalid_argument( "mesh adaptation: the domain must be the whole mesh" );
+        auto const& import = specs["/Meshes/laplacian/Import"_json_pointer];
+        geo_ = Environment::expand( import["filename"].get<std::string>() );
+        if ( std::filesystem::path( geo_ ).extension() != ".geo" )
+            throw std::invalid_argument( fmt::format( "mesh adaptation: the mesh must be imported from a .geo file, not {}", geo_ ) );
+        import_ = import;
+        import_.erase( "cache" );
+        history_ = nl::json::array();
+
+        auto exports = get_value( specs, "/PostProcess/laplacian/Exports", nl::json::object() );
+        std::string name = exports.value( "name", l_.id() > 0 ? fmt::format( "{}-{}", Environment::about().appName(), l_.id() ) : Environment::about().appName() );
+        bool steady = get_value( specs, "/TimeStepping/laplacian/steady", true );
+        double end = get_value( specs, "/TimeStepping/laplacian/end", 1.0 );
+
+        // state at the start of the first window, the initial conditions or a checkpoint
+        l_.setSpecs( specs );
+        l_.initialize();
+        auto states = l_.states();
+        double t0 = l_.time();
+        int step0 = l_.step();
+        double window = steady || options_.window <= 0 ? end - t0 : options_.window;
+        int nwindows = steady ? 1 : std::max( 1, static_cast<int>( std::ceil( ( end - t0 ) / window - 1e-10 ) ) );
+        double tstart = t0;
+        std::string key;
+        for ( int w = 0; w < nwindows; ++w )
+        {
+            if ( !steady )
+                specs["/TimeStepping/laplacian/end"_json_pointer] = w + 1 == nwindows ? end : tstart + ( w + 1 ) * window;
+            if ( nwindows > 1 )
+                specs["/PostProcess/laplacian/Exports/name"_json_pointer] = fmt::format( "{}-amr{}", name, w );
+            std::map<std::string, double> previous;
+            for ( int it = 0;; ++it )
+            {
+                l_.setSpecs( specs );
+                l_.setTransferredState( t0, step0, states );
+                l_.run();
+                auto q = quantities();
+                auto eta = l_.errorIndicator();
+                std::vector<double> eta2;
+                for ( auto const& eltWrap : elements( l_.mesh() ) )
+                    eta2.push_back( eta.localToGlobal( unwrap_ref( eltWrap ).id(), 0, 0 ) );
+                double estimate = std::accumulate( eta2.begin(), eta2.end(), 0. );
+                MPI_Allreduce( MPI_IN_PLACE, &estimate, 1, MPI_DOUBLE, MPI_SUM, comm() );
+                estimate = std::sqrt( estimate );
+                std::size_t dofs = l_.Xh()->nDof();
+                history_.push_back( { { "window", w },
+                                      { "iteration", it },
+                                      { "time", l_.time() },
+                                      { "elements", l_.mesh()->numGlobalElements() },
+                                      { "dofs", dofs },
+                                      { "estimate", estimate },
+                                      { "measures", q } } );
+                if ( Environment::isMasterRank() )
+                    std::cout << fmt::format( "[laplacian] adaptation window {} iteration {}: {} dofs, estimate {:.3e}", w, it, dofs, estimate ) << std::endl;
+
+                bool converged = ( it > 0 && !q.empty() && close( q, previous ) ) || ( options_.estimate > 0 && estimate <= options_.estimate );
+                if ( converged || it + 1 >= options_.maxIterations || ( options_.maxDofs > 0 && dofs >= options_.maxDofs ) )
+                {
+                    LOG( INFO ) << fmt::format( "adaptation of window {} stopped after {} iterations, converged: {}", w, it + 1, converged );
+                    break;
+                }
+                previous = q;
+                // the states of the start of the window stay on their mesh
+                // and are interpolated on the next one
+                specs["/Meshes/laplacian/Import"_json_pointer] = remesh( eta, dorflerThreshold( eta2, options_.theta, comm() ), w, it );
+                // the cache keeps the mesh of the instance only
+                if ( !key.empty() )
+                {
+                    ObjectCache<typename laplacian_type::space_t>::instance().erase( key );
+                    ObjectCache<mesh_t>::instance().erase( key );
+                }
+                key = meshCacheKey( specs["/Meshes/laplacian/Import"_json_pointer], Environment::numberOfProcessors() );
+            }
+            states = l_.states();
+            t0 = l_.time();
+            step0 = l_.step();
+        }
+        if ( !options_.filename.empty() && Environment::isMasterRank() )
+            std::ofstream( Environment::expand( options_.filename ) ) << history_.dump( 2 );
+    }
+
+private:
+    MPI_Comm comm() const { return l_.mesh()->worldComm(); }
+
+    //! final values of the measures of interest
+    std::map<std::string, double> quantities() const
+    {
+        std::map<std::string, double> q;
+        auto const& store = l_.measuresStore();
+        for ( auto const& name : store.names() )
+        {
+            auto const& v = store.values( name );
+            bool interest = std::any_of( options_.measures.begin(), options_.measures.end(), [&name]( auto const& p ) { return name.compare( 0, p.size(), p ) == 0; } );
+            if ( interest && !v.empty() )
+                q[name] = v.back();
+        }
+        return q;
+    }
+
+    //! @return true if the measures @p q changed less than the tolerance from @p p
+    bool close( std::map<std::string, double> const& q, std::map<std::string, double> const& p ) const
+    {
+        for ( auto const& [name, v] : q )
+        {
+            auto it = p.find( name );
+            if ( it == p.end() )
+                return false;
+            double scale = std::max( std::abs( v ), std::abs( it->second ) );
+            if ( std::abs( v - it->second ) > options_.tolerance * scale && scale > 1e-14 )
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief write the geometry meshed with the sizes of the marked elements divided, collective
+     *
+     * @return the import spec of the geometry
+     */
+    nl::json remesh( p0_element_t const& eta, double threshold, int window, int iteration ) const
+    {
+        namespace fs = std::filesystem;
+        auto const& mesh = l_.mesh();
+        auto const& wc = mesh->worldComm();
+        fs::path dir = fs::absolute( Environment::expand( options_.directory ) );
+        if ( wc.isMasterRank() )
+            fs::create_directories( dir );
+        wc.barrier();
+        auto stem = fmt::format( "{}-{}-{}-{}", fs::path( geo_ ).stem().string(), l_.id(), window, iteration );
+        auto view = [&]( int rank ) { return ( dir / fmt::format( "{}-{}.pos", stem, rank ) ).string(); };
+        writeSizeField( mesh, view( wc.rank() ), [&]( auto const& elt ) {
+            double f = eta.localToGlobal( elt.id(), 0, 0 ) >= threshold ? options_.refinement : options_.coarsening;
+            return std::clamp( f * elt.h(), options_.hmin, options_.hmax );
+        } );
+        auto geo = ( dir / ( stem + ".geo" ) ).string();
+        wc.barrier();
+        if ( wc.isMasterRank() )
+        {
+            std::vector<std::string> views;
+            for ( int r = 0; r < wc.size(); ++r )
+                views.push_back( view( r ) );
+            writeAdaptedGeometry( geo_, views, geo );
+        }
+        wc.barrier();
+        nl::json import = import_;
+        import["filename"] = geo;
+        return import;
+    }
+
+    laplacian_type& l_;
+    AdaptationOptions options_;
+    std::string geo_;
+    nl::json import_;
+    nl::json history_ = nl::json::array();
+};
+
+} // namespace Feel
@@ -0,0 +1,165 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief process-wide cache of the meshes and function spaces
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-12
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <feel/feelcore/environment.hpp>
+#include <feel/feelcore/json.hpp>
+#include <feel/feelfilters/loadmesh.hpp>
+#include <fmt/core.h>
+
+namespace Feel
+{
+/**
+ * @brief process-wide cache of shared objects of type T indexed by a key
+ *
+ * the objects are kept alive until clear() is called. The objects are built
+ * under the lock so that all the ranks build them in the same order, which
+ * matters for the collective operations of the mesh partitioning.
+ */
+template <typename T>
+class ObjectCache
+{
+public:
+    static ObjectCache& instance()
+    {
+        static ObjectCache c;
+        return c;
+    }
+
+    //! @return the object of @p key, built by @p make if it is not in the cache
+    template <typename F>
+    std::shared_ptr<T> get( std::string const& key, F&& make )
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        if ( auto it = objects_.find( key ); it != objects_.end() )
+        {
+            ++hits_;
+            return it->second;
+        }
+        auto o = make();
+        objects_[key] = o;
+        return o;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        objects_.clear();
+    }
+    //! release the objects whose key starts with @p prefix, the users keep theirs
+    void erase( std::string const& prefix )
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        for ( auto it = objects_.lower_bound( prefix ); it != objects_.end() && it->first.compare( 0, prefix.size(), prefix ) == 0; )
+            it = objects_.erase( it );
+    }
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        return objects_.size();
+    }
+    std::size_t hits() const
+    {
+        std::lock_guard<std::mutex> lock( mutex_ );
+        return hits_;
+    }
+
+private:
+    ObjectCache() = default;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<T>> objects_;
+    std::size_t hits_ = 0;
+};
+
+/**
+ * @brief key of a mesh in the cache
+ *
+ * the mesh depends on the expanded filename and the other entries of the
+ * import spec, the gmsh variables and mesh size and the number of partitions
+ *
+ * @param import /Meshes/<model>/Import spec
+ * @param nparts number of partitions
+ */
+inline std::string meshCacheKey( nl::json const& import, int nparts )
+{
+    nl::json j = import;
+    j["filename"] = Environment::expand( import["filename"].get<std::string>() );
+    j.erase( "cache" );
+    return fmt::format( "{}|geo-variables={}|hsize={}|np={}", j.dump(), soption( "gmsh.geo-variables-list" ), doption( "gmsh.hsize" ), nparts );
+}
+
+//! 64-bit FNV-1a hash of @p s, the same in every run unlike std::hash
+inline std::uint64_t fnv1a( std::string const& s )
+{
+    std::uint64_t h = 14695981039346656037ull;
+    for ( unsigned char c : s )
+        h = ( h ^ c ) * 1099511628211ull;
+    return h;
+}
+
+/**
+ * @brief load the mesh of an import spec, possibly from the on-disk cache
+ *
+ * if "cache" is set to a directory in the import spec, the partitioned mesh
+ * is saved there in the json+hdf5 format on the first load and read back on
+ * the next runs, which skips the gmsh meshing and the partitioning
+ *
+ * @param import /Meshes/<model>/Import spec
+ * @param key key of the mesh, see meshCacheKey()
+ */
+template <typename MeshType>
+std::shared_ptr<MeshType> loadMeshCached( nl::json const& import, std::string const& key )
+{
+    auto filename = Environment::expand( import["filename"].get<std::string>() );
+    if ( !import.contains( "cache" ) )
+        return loadMesh( _mesh = new MeshType, _filename = filename );
+
+    namespace fs = std::filesystem;
+    fs::path dir = Environment::expand( import["cache"].get<std::string>() );
+    auto cached = ( dir / fmt::format( "{}-{:016x}.json", fs::path( filename ).stem().string(), fnv1a( key ) ) ).string();
+    if ( fs::exists( cached ) )
+    {
+        LOG( INFO ) << fmt::format( "load mesh {} from the cache {}", filename, cached );
+        return loadMesh( _mesh = new MeshType, _filename = cached );
+    }
+    auto mesh = loadMesh( _mesh = new MeshType, _filename = filename );
+    if ( Environment::isMasterRank() )
+        fs::create_directories( dir );
+    Environment::worldComm().barrier();
+    mesh->saveHDF5( cached );
+    LOG( INFO ) << fmt::format( "save mesh {} in the cache {}", filename, cached );
+    return mesh;
+}
+
+} // namespace Feel
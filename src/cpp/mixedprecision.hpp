@@ -0,0 +1,348 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief single precision conjugate gradient with double precision iterative refinement
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-21
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <feel/feelcore/environment.hpp>
+#include <feel/feelcore/json.hpp>
+#include <fmt/core.h>
+#include <petscmat.h>
+
+namespace Feel
+{
+/**
+ * @brief rows of a sparse matrix in single precision
+ *
+ * The columns are numbered locally: the owned columns first, in the order
+ * of the rows, then the ghost columns. Values and column indices of 4 bytes
+ * read 8 bytes per nonzero in a product instead of 12 for the double
+ * precision matrix.
+ */
+struct FloatCsr
+{
+    std::vector<std::int64_t> rowptr{ 0 };
+    std::vector<std::int32_t> cols;
+    std::vector<float> vals;
+    //! number of ghost columns
+    int nghosts = 0;
+
+    int nrows() const { return static_cast<int>( rowptr.size() ) - 1; }
+
+    //! y = A x, @p x holds the owned then the ghost values
+    void mult( float const* x, float* y ) const
+    {
+        int n = nrows();
+#pragma omp parallel for schedule( static )
+        for ( int i = 0; i < n; ++i )
+        {
+            float s = 0;
+            std::int64_t b = rowptr[i], e = rowptr[i + 1];
+#pragma omp simd reduction( + : s )
+            for ( std::int64_t k = b; k < e; ++k )
+                s += vals[k] * x[cols[k]];
+            y[i] = s;
+        }
+    }
+
+    //! @return the diagonal of the owned rows
+    std::vector<float> diagonal() const
+    {
+        std::vector<float> d( nrows(), 0 );
+        for ( int i = 0; i < nrows(); ++i )
+            for ( std::int64_t k = rowptr[i]; k < rowptr[i + 1]; ++k )
+                if ( cols[k] == i )
+                    d[i] = vals[k];
+        return d;
+    }
+};
+
+/**
+ * @brief preconditioned conjugate gradient in single precision
+ *
+ * The dot products are accumulated in double precision and reduced over
+ * @p comm. The iterations stop when the residual is reduced by @p rtol.
+ *
+ * @param A matrix of the owned rows
+ * @param dinv inverse of the diagonal, Jacobi preconditioner
+ * @param exchange fills the ghost values of a vector of size nrows + nghosts
+ * @param b right hand side
+ * @param x solution, starts from zero
+ * @return the number of iterations
+ */
+template <typename Exchange>
+int floatPcg( MPI_Comm comm, FloatCsr const& A, std::vector<float> const& dinv, Exchange&& exchange,
+              std::vector<float> const& b, std::vector<float>& x, double rtol, int maxit )
+{
+    int n = A.nrows();
+    std::vector<float> r( b ), z( n ), p( n + A.nghosts ), q( n );
+    x.assign( n, 0.f );
+    auto dot = [&]( std::vector<float> const& u, std::vector<float> const& v ) {
+        double s = 0;
+#pragma omp parallel for reduction( + : s ) schedule( static )
+        for ( int i = 0; i < n; ++i )
+            s += double( u[i] ) * v[i];
+        MPI_Allreduce( MPI_IN_PLACE, &s, 1, MPI_DOUBLE, MPI_SUM, comm );
+        return s;
+    };
+    double r0 = std::sqrt( dot( r, r ) );
+    if ( r0 == 0 )
+        return 0;
+    for ( int i = 0; i < n; ++i )
+        p[i] = z[i] = dinv[i] * r[i];
+    double rz = dot( r, z );
+    int it = 0;
+    while ( it < maxit )
+    {
+        ++it;
+        exchange( p.data() );
+        A.mult( p.data(), q.data() );
+        float alpha = static_cast<float>( rz / dot( p, q ) );
+#pragma omp parallel for schedule( static )
+        for ( int i = 0; i < n; ++i )
+        {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+        }
+        if ( std::sqrt( dot( r, r ) ) <= rtol * r0 )
+            break;
+        for ( int i = 0; i < n; ++i )
+            z[i] = dinv[i] * r[i];
+        double rzn = dot( r, z );
+        float beta = static_cast<float>( rzn / rz );
+        rz = rzn;
+        for ( int i = 0; i < n; ++i )
+            p[i] = z[i] + beta * p[i];
+    }
+    return it;
+}
+
+/**
+ * @brief solve A x = b with single precision inner iterations
+ *
+ * A copy of the rows of the process of A is kept in single precision with
+ * its Jacobi preconditioner. Each refinement computes the residual
+ * r = b - A x in double precision with A, solves A d = r approximately with
+ * floatPcg() and updates x += d, until the residual is reduced by the
+ * requested tolerance. The inner iterations only need a single precision
+ * accuracy, the accuracy of the solution is the one of the double
+ * precision residual.
+ *
+ * Options, see /Solver/laplacian/mixed_precision:
+ * {"enabled": false, "inner_rtol": 1e-3, "inner_maxit": 1000, "max_refinements": 30}
+ */
+class MixedPrecisionSolver
+{
+public:
+    struct Options
+    {
+        bool enabled = false;
+        double innerRtol = 1e-3;
+        int innerMaxit = 1000;
+        int maxRefinements = 30;
+
+        Options() = default;
+        explicit Options( nl::json const& j )
+        {
+            if ( j.is_boolean() )
+                enabled = j.get<bool>();
+            else if ( j.is_object() )
+            {
+                enabled = j.value( "enabled", true );
+                innerRtol = j.value( "inner_rtol", innerRtol );
+                innerMaxit = j.value( "inner_maxit", innerMaxit );
+                maxRefinements = j.value( "max_refinements", maxRefinements );
+            }
+        }
+    };
+
+    MixedPrecisionSolver( MPI_Comm comm, Options const& o ) : comm_( comm ), options_( o ) {}
+    MixedPrecisionSolver( MixedPrecisionSolver const& ) = delete;
+    MixedPrecisionSolver& operator=( MixedPrecisionSolver const& ) = delete;
+    ~MixedPrecisionSolver() { destroy(); }
+
+    Options const& options() const { return options_; }
+    FloatCsr const& matrix() const { return A_; }
+    //! number of refinements of the last solve
+    int refinements() const { return refinements_; }
+    //! @return true if the last solve reached its tolerance
+    bool converged() const { return converged_; }
+
+    /**
+     * @brief copy the rows of the process of @p A in single precision, collective
+     *
+     * @p A must be assembled, with an explicit diagonal
+     */
+    void setOperator( Mat A )
+    {
+        destroy();
+        Ad_ = A;
+        PetscErrorCode ierr;
+        PetscInt rstart, rend;
+        ierr = MatGetOwnershipRange( A, &rstart, &rend );
+        CHKERRABORT( comm_, ierr );
+        int n = rend - rstart;
+        A_ = FloatCsr();
+        std::map<PetscInt, std::int32_t> ghosts;
+        std::vector<PetscInt> gcols;
+        for ( PetscInt row = rstart; row < rend; ++row )
+        {
+            PetscInt ncols;
+            PetscInt const* cols;
+            PetscScalar const* vals;
+            ierr = MatGetRow( A, row, &ncols, &cols, &vals );
+            CHKERRABORT( comm_, ierr );
+            for ( PetscInt k = 0; k < ncols; ++k )
+            {
+                if ( cols[k] >= rstart && cols[k] < rend )
+                    A_.cols.push_back( static_cast<std::int32_t>( cols[k] - rstart ) );
+                else
+                {
+                    auto [it, inserted] = ghosts.try_emplace( cols[k], static_cast<std::int32_t>( n + ghosts.size() ) );
+                    if ( inserted )
+                        gcols.push_back( cols[k] );
+                    A_.cols.push_back( it->second );
+                }
+                A_.vals.push_back( static_cast<float>( PetscRealPart( vals[k] ) ) );
+            }
+            A_.rowptr.push_back( A_.cols.size() );
+            ierr = MatRestoreRow( A, row, &ncols, &cols, &vals );
+            CHKERRABORT( comm_, ierr );
+        }
+        A_.nghosts = static_cast<int>( gcols.size() );
+        MPI_Allreduce( &A_.nghosts, &maxGhosts_, 1, MPI_INT, MPI_MAX, comm_ );
+        auto d = A_.diagonal();
+        dinv_.resize( n );
+        for ( int i = 0; i < n; ++i )
+            dinv_[i] = d[i] != 0 ? 1.f / d[i] : 1.f;
+
+        // scatter of the ghost values from the layout of A
+        ierr = MatCreateVecs( A, &xg_, nullptr );
+        CHKERRABORT( comm_, ierr );
+        ierr = VecCreateSeq( PETSC_COMM_SELF, A_.nghosts, &gh_ );
+        CHKERRABORT( comm_, ierr );
+        IS is;
+        ierr = ISCreateGeneral( PETSC_COMM_SELF, A_.nghosts, gcols.data(), PETSC_COPY_VALUES, &is );
+        CHKERRABORT( comm_, ierr );
+        ierr = VecScatterCreate( xg_, is, gh_, nullptr, &scatter_ );
+        CHKERRABORT( comm_, ierr );
+        ISDestroy( &is );
+        ierr = VecDuplicate( xg_, &r_ );
+        CHKERRABORT( comm_, ierr );
+    }
+
+    /**
+     * @brief solve A x = b
+     *
+     * @param x initial guess and solution
+     * @param rtol reduction of the residual
+     * @param atol absolute tolerance on the residual
+     * @return the number of inner iterations
+     */
+    int solve( Vec b, Vec x, double rtol, double atol )
+    {
+        PetscErrorCode ierr;
+        int n = A_.nrows(), its = 0;
+        std::vector<float> rf( n ), df( n );
+        PetscReal bn, rn;
+        ierr = VecNorm( b, NORM_2, &bn );
+        CHKERRABORT( comm_, ierr );
+        auto exchange = [this, n]( float* v ) {
+            // the scatter is collective, it is skipped only if no rank has ghosts
+            if ( maxGhosts_ == 0 )
+                return;
+            PetscScalar* a;
+            VecGetArray( xg_, &a );
+            for ( int i = 0; i < n; ++i )
+                a[i] = v[i];
+            VecRestoreArray( xg_, &a );
+            VecScatterBegin( scatter_, xg_, gh_, INSERT_VALUES, SCATTER_FORWARD );
+            VecScatterEnd( scatter_, xg_, gh_, INSERT_VALUES, SCATTER_FORWARD );
+            PetscScalar const* g;
+            VecGetArrayRead( gh_, &g );
+            for ( int i = 0; i < A_.nghosts; ++i )
+                v[n + i] = static_cast<float>( PetscRealPart( g[i] ) );
+            VecRestoreArrayRead( gh_, &g );
+        };
+        for ( refinements_ = 0;; ++refinements_ )
+        {
+            // residual in double precision
+            ierr = MatMult( Ad_, x, r_ );
+            CHKERRABORT( comm_, ierr );
+            ierr = VecAYPX( r_, -1., b );
+            CHKERRABORT( comm_, ierr );
+            ierr = VecNorm( r_, NORM_2, &rn );
+            CHKERRABORT( comm_, ierr );
+            if ( rn <= std::max( rtol * bn, atol ) || refinements_ == options_.maxRefinements )
+                break;
+            // the scaled residual stays in the range of single precision
+            PetscScalar const* ra;
+            VecGetArrayRead( r_, &ra );
+            for ( int i = 0; i < n; ++i )
+                rf[i] = static_cast<float>( PetscRealPart( ra[i] ) / rn );
+            VecRestoreArrayRead( r_, &ra );
+            its += floatPcg( comm_, A_, dinv_, exchange, rf, df, options_.innerRtol, options_.innerMaxit );
+            PetscScalar* xa;
+            VecGetArray( x, &xa );
+            for ( int i = 0; i < n; ++i )
+                xa[i] += rn * df[i];
+            VecRestoreArray( x, &xa );
+        }
+        converged_ = rn <= std::max( rtol * bn, atol );
+        if ( !converged_ )
+            LOG( WARNING ) << fmt::format( "mixed precision solve: residual {} after {} refinements, requested {}", rn / bn, refinements_, rtol );
+        return its;
+    }
+
+private:
+    void destroy()
+    {
+        VecScatterDestroy( &scatter_ );
+        VecDestroy( &xg_ );
+        VecDestroy( &gh_ );
+        VecDestroy( &r_ );
+    }
+
+    MPI_Comm comm_;
+    Options options_;
+    Mat Ad_ = nullptr;
+    FloatCsr A_;
+    std::vector<float> dinv_;
+    Vec xg_ = nullptr, gh_ = nullptr, r_ = nullptr;
+    VecScatter scatter_ = nullptr;
+    int maxGhosts_ = 0;
+    int refinements_ = 0;
+    bool converged_ = true;
+};
+
+} // namespace Feel
@@ -0,0 +1,442 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief reduced basis for the steady Laplacian parametrized by the material conductivities and the Robin coefficient
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-08
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <random>
+
+#include <Eigen/Dense>
+
+#include "laplacian.hpp"
+
+namespace Feel
+{
+/**
+ * @brief reduced basis of the steady Laplacian
+ *
+ * The parameter is mu = (k_0, ..., k_{n-1}, h) where k_i is the conductivity of
+ * the i-th material of the model and h the coefficient of the Robin
+ * conditions. The operator and the right hand side are affine in mu
+ * \f[
+ *   a(u,v;\mu) = \sum_i k_i \int_{\Omega_i} \nabla u \cdot \nabla v + h \int_{\Gamma_R} u v,\quad
+ *   f(v;\mu) = \int_{\Gamma_N} g v + h \int_{\Gamma_R} T_{ext} v
+ * \f]
+ * and the terms are assembled with Laplacian::assembleGradGrad,
+ * Laplacian::assembleMass and Laplacian::assembleFlux.
+ *
+ * The offline stage builds the basis with a greedy algorithm driven by the
+ * residual based bound of the output error
+ * \f$\Delta^s_N(\mu) = \|\ell\|_{X'} \|r(\mu)\|_{X'} / \alpha_{LB}(\mu)\f$,
+ * where X is the energy inner product at the reference parameter and
+ * \f$\alpha_{LB}\f$ the min-theta lower bound of the coercivity constant.
+ * Without output the bound of the error in the energy norm
+ * \f$\Delta_N(\mu) = \|r(\mu)\|_{X'} / \sqrt{\alpha_{LB}(\mu)}\f$ is used.
+ * The online stage only involves dense operations of the size of the basis.
+ *
+ * The output is the integral of u over the flux boundaries, the root
+ * temperature of the thermal fin, or over the markers given to setOutput().
+ */
+template <int Dim, int Order>
+class ReducedBasis
+{
+public:
+    using laplacian_t = Laplacian<Dim, Order>;
+    using element_t = typename laplacian_t::element_t;
+    using space_ptr_t = typename laplacian_t::space_ptr_t;
+
+    struct Online
+    {
+        //! output
+        double output = 0;
+        //! bound of the error on the output, 0 if the output is empty
+        double outputBound = 0;
+        //! bound of the error on the solution in the energy norm
+        double errorBound = 0;
+        //! coefficients of the solution in the basis
+        Eigen::VectorXd coefficients;
+    };
+
+    /**
+     * @brief set up the affine decomposition from an initialized Laplacian
+     *
+     * the flux and Robin data must be constant
+     */
+    explicit ReducedBasis( laplacian_t& l )
+        : l_( l ),
+          Xh_( l.Xh() )
+    {
+        auto const& specs = l.specs();
+        for ( auto const& mat : l.materials() )
+        {
+            materials_.push_back( mat.name );
+            Aq_.push_back( l.assembleGradGrad( { mat.name }, Eigen::MatrixXd::Identity( Dim, Dim ) ).matrixPtr() );
+        }
+        std::vector<std::string> robin;
+        auto bcs = specs["/BoundaryConditions/laplacian"_json_pointer];
+        Ff_.push_back( backend()->newVector( Xh_ ) );
+        if ( bcs.contains( "flux" ) )
+        {
+            for ( auto const& [bc, value] : bcs["flux"].items() )
+            {
+                Coefficient g( value["expr"] );
+                if ( !g.isConstant() )
+                    throw std::invalid_argument( fmt::format( "reduced basis: flux on {} must be constant", bc ) );
+                l.assembleFlux( Ff_[0], { bc }, g.value(), true );
+                output_.push_back( bc );
+            }
+        }
+        Ff_.push_back( backend()->newVector( Xh_ ) );
+        if ( bcs.contains( "convective_laplacian_flux" ) )
+        {
+            for ( auto const& [bc, value] : bcs["convective_laplacian_flux"].items() )
+            {
+                Coefficient h( value["h"] ), Text( value["Text"] );
+                if ( !h.isConstant() || !Text.isConstant() )
+                    throw std::invalid_argument( fmt::format( "reduced basis: h and Text on {} must be constant", bc ) );
+                // h scales all the Robin terms, the ratios to the first h are kept fixed
+                if ( robin.empty() )
+                    muRef_h_ = h.value();
+                robin.push_back( bc );
+                double r = h.value() / muRef_h_;
+                // the Robin terms are summed in place in one matrix
+                if ( robin.size() == 1 )
+                    Aq_.push_back( l.newMatrix() );
+                l.assembleMass( Aq_.back(), { bc }, r, true );
+                l.assembleFlux( Ff_[1], { bc }, r * Text.value(), true );
+            }
+        }
+        hasRobin_ = !robin.empty();
+        muRef_ = Eigen::VectorXd::Ones( nParameters() );
+        if ( hasRobin_ )
+            muRef_( nParameters() - 1 ) = muRef_h_;
+        setOutput( output_ );
+    }
+
+    //! number of parameters: one conductivity per material and h if there are Robin conditions
+    int nParameters() const { return static_cast<int>( materials_.size() ) + ( hasRobin_ ? 1 : 0 ); }
+    //! names of the parameters
+    std::vector<std::string> parameterNames() const
+    {
+        auto n = materials_;
+        if ( hasRobin_ )
+            n.push_back( "h" );
+        return n;
+    }
+    //! number of basis functions
+    int size() const { return static_cast<int>( Z_.size() ); }
+
+    //! set the markers of the output functional
+    void setOutput( std::vector<std::string> const& markers )
+    {
+        output_ = markers;
+        L_ = backend()->newVector( Xh_ );
+        if ( !markers.empty() )
+            l_.assembleFlux( L_, markers, 1. );
+    }
+
+    //! set the reference parameter defining the inner product, must be called before offline()
+    void setReferenceParameter( Eigen::VectorXd const& mu ) { muRef_ = mu; }
+
+    /**
+     * @brief build the basis with a greedy algorithm
+     *
+     * @param muMin lower bound of the parameter box
+     * @param muMax upper bound of the parameter box
+     * @param nmax maximum size of the basis
+     * @param tol tolerance on the relative output error bound
+     * @param ntrain size of the random training set, log-uniform in the box
+     * @param seed seed of the training set
+     * @return the maximum error bound over the training set at each iteration
+     *
+     * The greedy never selects a training parameter twice and stops with a
+     * warning when a snapshot is numerically in the span of the basis.
+     */
+    std::vector<double> offline( Eigen::VectorXd const& muMin, Eigen::VectorXd const& muMax,
+                                 int nmax = 20, double tol = 1e-6, int ntrain = 1000, unsigned seed = 0 )
+    {
+        if ( muMin.size() != nParameters() || muMax.size() != nParameters() )
+            throw std::invalid_argument( fmt::format( "reduced basis: expected {} parameters", nParameters() ) );
+        std::mt19937 gen( seed );
+        std::uniform_real_distribution<double> unif( 0, 1 );
+        std::vector<Eigen::VectorXd> train( ntrain, Eigen::VectorXd( nParameters() ) );
+        for ( auto& mu : train )
+            for ( int p = 0; p < nParameters(); ++p )
+                mu( p ) = muMin( p ) * std::pow( muMax( p ) / muMin( p ), unif( gen ) );
+
+        // the inner product and the affine right hand side representers
+        X_ = assembleOperator( muRef_ );
+        Z_.clear();
+        XZ_.clear();
+        Lhat_.clear();
+        Fhat_.clear();
+        for ( auto const& f : Ff_ )
+            Fhat_.push_back( riesz( f ) );
+        auto Lhat = riesz( L_ );
+        normL_ = std::sqrt( std::max( 0., L_->dot( *Lhat ) ) );
+        CC_.resize( Qf(), Qf() );
+        for ( int f = 0; f < Qf(); ++f )
+            for ( int g = 0; g < Qf(); ++g )
+                CC_( f, g ) = Ff_[f]->dot( *Fhat_[g] );
+
+        std::vector<double> errors;
+        std::vector<bool> selected( ntrain, false );
+        Eigen::VectorXd mu = muRef_;
+        for ( int n = 0; n < nmax; ++n )
+        {
+            if ( !addBasisFunction( truthSolve( mu ) ) )
+            {
+                LOG( WARNING ) << fmt::format( "reduced basis: the snapshot is in the span of the basis, stop the greedy at N={}", size() );
+                break;
+            }
+            double maxerr = -1;
+            int next = -1;
+            for ( int i = 0; i < ntrain; ++i )
+            {
+                if ( selected[i] )
+                    continue;
+                auto const& m = train[i];
+                auto o = online( m );
+                // without output, e.g. no flux boundary, the relative bound
+                // of the error in the energy norm drives the greedy
+                double err = normL_ > 0 ? o.outputBound / std::max( std::abs( o.output ), std::numeric_limits<double>::min() )
+                                        : o.errorBound / std::max( std::sqrt( std::max( ( FfN_ * thetaF( m ) ).dot( o.coefficients ), 0. ) ),
+                                                                   std::numeric_limits<double>::min() );
+                if ( err > maxerr )
+                {
+                    maxerr = err;
+                    next = i;
+                }
+            }
+            if ( next < 0 )
+            {
+                LOG( WARNING ) << fmt::format( "reduced basis: no training parameter left, stop the greedy at N={}", size() );
+                break;
+            }
+            errors.push_back( maxerr );
+            LOG( INFO ) << fmt::format( "reduced basis: N={} max relative bound={:.3e}", size(), maxerr );
+            if ( maxerr < tol )
+                break;
+            selected[next] = true;
+            mu = train[next];
+        }
+        return errors;
+    }
+
+    /**
+     * @brief solve the reduced problem
+     *
+     * @param mu parameter
+     * @return output, error bounds and coefficients of the reduced solution
+     */
+    Online online( Eigen::VectorXd const& mu ) const
+    {
+        if ( size() == 0 )
+            throw std::logic_error( "reduced basis: the offline stage has not been run" );
+        if ( mu.size() != nParameters() )
+            throw std::invalid_argument( fmt::format( "reduced basis: expected {} parameters", nParameters() ) );
+        auto ta = thetaA( mu );
+        auto tf = thetaF( mu );
+        int N = size();
+        Eigen::MatrixXd A = Eigen::MatrixXd::Zero( N, N );
+        for ( int q = 0; q < Qa(); ++q )
+            A += ta( q ) * AqN_[q];
+        Eigen::VectorXd F = FfN_ * tf;
+
+        Online o;
+        o.coefficients = A.ldlt().solve( F );
+        o.output = LN_.dot( o.coefficients );
+
+        // dual norm of the residual from the offline inner products
+        Eigen::VectorXd w( Qa() * N );
+        for ( int q = 0; q < Qa(); ++q )
+            w.segment( q * N, N ) = ta( q ) * o.coefficients;
+        double r2 = tf.dot( CC_ * tf ) - 2 * tf.dot( CL_.leftCols( Qa() * N ) * w ) + w.dot( LL_.topLeftCorner( Qa() * N, Qa() * N ) * w );
+        double alpha = ( ta.array() / thetaA( muRef_ ).array() ).minCoeff();
+        o.errorBound = std::sqrt( std::max( r2, 0. ) / alpha );
+        // |s - s_N| <= |l|_X' |e|_X <= |l|_X' |r|_X' / alpha
+        o.outputBound = normL_ * std::sqrt( std::max( r2, 0. ) ) / alpha;
+        return o;
+    }
+
+    //! @return the finite element field of the reduced solution with @p coefficients
+    element_t expand( Eigen::VectorXd const& coefficients ) const
+    {
+        auto u = backend()->newVector( Xh_ );
+        for ( int n = 0; n < size(); ++n )
+            u->add( coefficients( n ), *Z_[n] );
+        u->close();
+        element_t e = Xh_->element();
+        e = *u;
+        return e;
+    }
+
+    //! @return the finite element solution at @p mu
+    element_t truth( Eigen::VectorXd const& mu ) const
+    {
+        element_t e = Xh_->element();
+        e = *truthSolve( mu );
+        return e;
+    }
+
+private:
+    int Qa() const { return static_cast<int>( Aq_.size() ); }
+    int Qf() const { return static_cast<int>( Ff_.size() ); }
+
+    Eigen::VectorXd thetaA( Eigen::VectorXd const& mu ) const { return mu.head( Qa() ); }
+    Eigen::VectorXd thetaF( Eigen::VectorXd const& mu ) const
+    {
+        Eigen::VectorXd t( Qf() );
+        t << 1., hasRobin_ ? mu( nParameters() - 1 ) : 0.;
+        return t;
+    }
+
+    sparse_matrix_ptrtype assembleOperator( Eigen::VectorXd const& mu ) const
+    {
+        auto ta = thetaA( mu );
+        auto A = backend()->newMatrix( _test = Xh_, _trial = Xh_ );
+        A->zero();
+        for ( int q = 0; q < Qa(); ++q )
+            A->addMatrix( ta( q ), *Aq_[q] );
+        A->close();
+        return A;
+    }
+
+    vector_ptrtype truthSolve( Eigen::VectorXd const& mu ) const
+    {
+        auto tf = thetaF( mu );
+        auto F = backend()->newVector( Xh_ );
+        for ( int f = 0; f < Qf(); ++f )
+            F->add( tf( f ), *Ff_[f] );
+        F->close();
+        auto u = backend()->newVector( Xh_ );
+        backend( _name = "rb", _rebuild = true )->solve( _matrix = assembleOperator( mu ), _solution = u, _rhs = F );
+        return u;
+    }
+
+    //! @return the Riesz representer of @p f for the X inner product
+    vector_ptrtype riesz( vector_ptrtype const& f ) const
+    {
+        auto r = backend()->newVector( Xh_ );
+        backend( _name = "rb-riesz" )->solve( _matrix = X_, _solution = r, _rhs = f );
+        return r;
+    }
+
+    /**
+     * @brief orthonormalize @p u in X and update the reduced and residual quantities
+     *
+     * @return false, leaving the basis unchanged, if the norm of @p u after
+     * Gram-Schmidt is below orthogonalizationTolerance relative to its norm
+     */
+    bool addBasisFunction( vector_ptrtype u )
+    {
+        auto Xu = backend()->newVector( Xh_ );
+        X_->multVector( *u, *Xu );
+        double norm0 = std::sqrt( std::max( 0., u->dot( *Xu ) ) );
+        // modified Gram-Schmidt, twice for stability
+        for ( int pass = 0; pass < 2; ++pass )
+            for ( int n = 0; n < size(); ++n )
+                u->add( -u->dot( *XZ_[n] ), *Z_[n] );
+        X_->multVector( *u, *Xu );
+        double norm = std::sqrt( std::max( 0., u->dot( *Xu ) ) );
+        if ( norm <= orthogonalizationTolerance * norm0 || norm == 0 )
+            return false;
+        u->scale( 1. / norm );
+        Xu->scale( 1. / norm );
+        Z_.push_back( u );
+        XZ_.push_back( Xu );
+        int N = size();
+
+        // reduced operators, right hand sides and output
+        AqN_.resize( Qa() );
+        auto Au = backend()->newVector( Xh_ );
+        for ( int q = 0; q < Qa(); ++q )
+        {
+            AqN_[q].conservativeResize( N, N );
+            Aq_[q]->multVector( *u, *Au );
+            for ( int n = 0; n < N; ++n )
+            {
+                AqN_[q]( n, N - 1 ) = Z_[n]->dot( *Au );
+                AqN_[q]( N - 1, n ) = AqN_[q]( n, N - 1 );
+            }
+            // representer of a_q(z_N, .)
+            Lhat_.push_back( riesz( Au ) );
+        }
+        FfN_.conservativeResize( N, Qf() );
+        for ( int f = 0; f < Qf(); ++f )
+            FfN_( N - 1, f ) = u->dot( *Ff_[f] );
+        LN_.conservativeResize( N );
+        LN_( N - 1 ) = u->dot( *L_ );
+
+        // inner products of the representers, ordered by q then n
+        auto index = [N]( int q, int n ) { return q * N + n; };
+        Eigen::MatrixXd CL( Qf(), Qa() * N ), LL( Qa() * N, Qa() * N );
+        auto hat = [this]( int q, int n ) -> vector_ptrtype const& { return Lhat_[n * Qa() + q]; };
+        auto Aqz = [this, &Au]( int q, int n ) {
+            Aq_[q]->multVector( *Z_[n], *Au );
+            return Au;
+        };
+        for ( int q = 0; q < Qa(); ++q )
+            for ( int n = 0; n < N; ++n )
+            {
+                auto a = Aqz( q, n );
+                for ( int f = 0; f < Qf(); ++f )
+                    CL( f, index( q, n ) ) = a->dot( *Fhat_[f] );
+                for ( int q2 = 0; q2 < Qa(); ++q2 )
+                    for ( int n2 = 0; n2 < N; ++n2 )
+                        LL( index( q, n ), index( q2, n2 ) ) = a->dot( *hat( q2, n2 ) );
+            }
+        CL_ = CL;
+        LL_ = LL;
+        return true;
+    }
+
+    //! relative norm of a snapshot after Gram-Schmidt below which it is in the span of the basis
+    static constexpr double orthogonalizationTolerance = 1e-10;
+
+    laplacian_t& l_;
+    space_ptr_t Xh_;
+    std::vector<std::string> materials_, output_;
+    bool hasRobin_ = false;
+    double muRef_h_ = 1;
+    Eigen::VectorXd muRef_;
+
+    // affine decomposition
+    std::vector<sparse_matrix_ptrtype> Aq_;
+    std::vector<vector_ptrtype> Ff_;
+    vector_ptrtype L_;
+
+    // basis, X times the basis and Riesz representers
+    sparse_matrix_ptrtype X_;
+    std::vector<vector_ptrtype> Z_, XZ_, Fhat_, Lhat_;
+    double normL_ = 0;
+
+    // reduced quantities
+    std::vector<Eigen::MatrixXd> AqN_;
+    Eigen::MatrixXd FfN_;
+    Eigen::VectorXd LN_;
+    Eigen::MatrixXd CC_, CL_, LL_;
+};
+
+} // namespace Feel
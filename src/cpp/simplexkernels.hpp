@@ -0,0 +1,388 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief reference element matrices of Lagrange elements on simplices
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-13
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <fmt/core.h>
+
+namespace Feel
+{
+/**
+ * @brief Gauss-Legendre rule with @p n points on [0,1]
+ */
+inline void gaussLegendre01( int n, std::vector<double>& x, std::vector<double>& w )
+{
+    x.resize( n );
+    w.resize( n );
+    for ( int i = 0; i < n; ++i )
+    {
+        double z = std::cos( M_PI * ( i + 0.75 ) / ( n + 0.5 ) ), dp = 1;
+        for ( int it = 0; it < 100; ++it )
+        {
+            // Legendre polynomials p1 = P_n(z) and p0 = P_{n-1}(z)
+            double p0 = 0, p1 = 1;
+            for ( int k = 1; k <= n; ++k )
+            {
+                double p2 = p0;
+                p0 = p1;
+                p1 = ( ( 2 * k - 1 ) * z * p0 - ( k - 1 ) * p2 ) / k;
+            }
+            dp = n * ( z * p1 - p0 ) / ( z * z - 1 );
+            double dz = p1 / dp;
+            z -= dz;
+            if ( std::abs( dz ) < 1e-15 )
+                break;
+        }
+        x[i] = ( 1 - z ) / 2;
+        w[i] = 1 / ( ( 1 - z * z ) * dp * dp );
+    }
+}
+
+/**
+ * @brief quadrature on the reference simplex of Feel++
+ *
+ * the reference simplex has the vertices (-1,...,-1) and (-1,...,1,...,-1),
+ * the rule is a collapsed tensor product of Gauss-Legendre rules exact for
+ * polynomials of degree @p degree
+ *
+ * @return the points, one per column, and the weights
+ */
+template <int Dim>
+std::pair<Eigen::MatrixXd, Eigen::VectorXd> simplexQuadrature( int degree )
+{
+    static_assert( Dim >= 1 && Dim <= 3, "simplex quadrature in dimension 1, 2 or 3" );
+    std::vector<double> x, w;
+    // the collapse adds up to Dim-1 to the degree in the first direction
+    gaussLegendre01( ( degree + Dim - 1 ) / 2 + 1, x, w );
+    int n = x.size(), npts = std::pow( n, Dim );
+    Eigen::MatrixXd pts( Dim, npts );
+    Eigen::VectorXd wts( npts );
+    for ( int q = 0; q < npts; ++q )
+    {
+        int i = q % n, j = ( q / n ) % n, k = q / ( n * n );
+        Eigen::Vector3d xi;
+        double wq;
+        if constexpr ( Dim == 1 )
+        {
+            xi << x[i], 0, 0;
+            wq = w[i];
+        }
+        else if constexpr ( Dim == 2 )
+        {
+            xi << x[i], x[j] * ( 1 - x[i] ), 0;
+            wq = w[i] * w[j] * ( 1 - x[i] );
+        }
+        else
+        {
+            xi << x[i], x[j] * ( 1 - x[i] ), x[k] * ( 1 - x[i] ) * ( 1 - x[j] );
+            wq = w[i] * w[j] * w[k] * ( 1 - x[i] ) * ( 1 - x[i] ) * ( 1 - x[j] );
+        }
+        pts.col( q ) = ( ( 2 * xi.head<Dim>() ).array() - 1 ).matrix();
+        wts( q ) = wq * std::pow( 2, Dim );
+    }
+    return { pts, wts };
+}
+
+/**
+ * @brief reference matrices of the Lagrange basis on a simplex
+ *
+ * The basis is defined by its nodes on the reference simplex of Feel++, in
+ * the order of the local dofs, and expanded on the monomials of degree at
+ * most @c order. For an affine element with jacobian J the element matrices
+ * are combinations of the reference matrices:
+ * \f[
+ *   K = \sum_{a \le b} G_{ab} T_{ab},\quad G = |\det J| J^{-1} J^{-T},\quad M = |\det J| M_{ref}
+ * \f]
+ * where \f$T_{aa} = S_{aa}\f$ and \f$T_{ab} = S_{ab} + S_{ba}\f$ with
+ * \f$S_{ab} = \int \partial_a \phi_j \partial_b \phi_i\f$.
+ */
+template <int Dim>
+class SimplexKernels
+{
+public:
+    static constexpr int nPairs = Dim * ( Dim + 1 ) / 2;
+
+    /**
+     * @param nodes reference coordinates of the nodes, one column per local dof
+     * @param order polynomial order
+     */
+    SimplexKernels( Eigen::MatrixXd const& nodes, int order )
+        : order_( order )
+    {
+        // exponents of the monomials of degree <= order
+        for ( int e = 0; e < std::pow( order + 1, Dim ); ++e )
+        {
+            Eigen::Matrix<int, Dim, 1> a;
+            int r = e, deg = 0;
+            for ( int d = 0; d < Dim; ++d, r /= ( order + 1 ) )
+                deg += a( d ) = r % ( order + 1 );
+            if ( deg <= order )
+                exponents_.push_back( a );
+        }
+        n_ = nodes.cols();
+        if ( n_ != static_cast<int>( exponents_.size() ) )
+            throw std::invalid_argument( fmt::format( "simplex kernels: {} nodes for {} monomials", n_, exponents_.size() ) );
+
+        // coefficients of the nodal basis: phi_j = sum_p C(p,j) m_p
+        Eigen::MatrixXd V( n_, n_ );
+        for ( int i = 0; i < n_; ++i )
+            V.row( i ) = monomials( nodes.col( i ) ).transpose();
+        C_ = V.inverse();
+
+        auto [pts, wts] = simplexQuadrature<Dim>( 2 * order );
+        mass_.setZero( n_, n_ );
+        std::vector<Eigen::MatrixXd> S( Dim * Dim, Eigen::MatrixXd::Zero( n_, n_ ) );
+        for ( int q = 0; q < pts.cols(); ++q )
+        {
+            Eigen::VectorXd phi = values( pts.col( q ) );
+            Eigen::MatrixXd dphi = gradients( pts.col( q ) );
+            mass_ += wts( q ) * phi * phi.transpose();
+            for ( int a = 0; a < Dim; ++a )
+                for ( int b = 0; b < Dim; ++b )
+                    S[a * Dim + b] += wts( q ) * dphi.col( b ) * dphi.col( a ).transpose();
+        }
+        for ( int a = 0, p = 0; a < Dim; ++a )
+            for ( int b = a; b < Dim; ++b, ++p )
+                T_[p] = ( a == b ) ? S[a * Dim + a] : Eigen::MatrixXd( S[a * Dim + b] + S[b * Dim + a] );
+
+        // mass on the faces, the face v is opposite to the vertex v
+        if constexpr ( Dim > 1 )
+        {
+            auto [fpts, fwts] = simplexQuadrature<Dim - 1>( 2 * order );
+            Eigen::Matrix<double, Dim, Dim + 1> vertices = -Eigen::Matrix<double, Dim, Dim + 1>::Ones();
+            for ( int d = 0; d < Dim; ++d )
+                vertices( d, d + 1 ) = 1;
+            for ( int v = 0; v <= Dim; ++v )
+            {
+                Eigen::Matrix<double, Dim, Dim> F;
+                for ( int k = 0, c = 0; k <= Dim; ++k )
+                    if ( k != v )
+                        F.col( c++ ) = vertices.col( k );
+                Eigen::Matrix<double, Dim, Dim - 1> E = ( F.rightCols( Dim - 1 ).colwise() - F.col( 0 ) ) / 2;
+                double jac = std::sqrt( ( E.transpose() * E ).determinant() );
+                faceMass_[v].setZero( n_, n_ );
+                for ( int q = 0; q < fpts.cols(); ++q )
+                {
+                    Eigen::Matrix<double, Dim, 1> x = F.col( 0 ) + E * ( fpts.col( q ).array() + 1 ).matrix();
+                    Eigen::VectorXd phi = values( x );
+                    faceMass_[v] += fwts( q ) * jac * phi * phi.transpose();
+                }
+                faceMeasure_[v] = fwts.sum() * jac;
+            }
+        }
+    }
+
+    /**
+     * @brief P1 matrices on the simplices joining the nodes
+     *
+     * The equispaced nodes of order k split the reference simplex into k^Dim
+     * simplices. The P1 stiffness and mass on this low order refined simplex
+     * act on the same local dofs with fewer couplings and are spectrally
+     * equivalent to the ones of order k: assembled, they precondition the
+     * operator of order k. The face masses are the diagonals of the ones of
+     * order k.
+     *
+     * @param nodes reference coordinates of the nodes given to the constructor
+     */
+    SimplexKernels lowOrderRefined( Eigen::MatrixXd const& nodes ) const
+    {
+        int N = order_;
+        // integer coordinates of the nodes on the lattice of step 2/N
+        std::map<std::array<int, Dim>, int> lattice;
+        for ( int i = 0; i < n_; ++i )
+        {
+            std::array<int, Dim> l;
+            for ( int d = 0; d < Dim; ++d )
+            {
+                double x = ( nodes( d, i ) + 1 ) * N / 2;
+                l[d] = static_cast<int>( std::lround( x ) );
+                if ( std::abs( x - l[d] ) > 1e-8 )
+                    throw std::invalid_argument( "low order refined simplex: the nodes are not equispaced" );
+            }
+            lattice[l] = i;
+        }
+
+        SimplexKernels low;
+        low.n_ = n_;
+        low.order_ = 1;
+        low.mass_.setZero( n_, n_ );
+        for ( auto& T : low.T_ )
+            T.setZero( n_, n_ );
+        // in the coordinates a_d = l_d + ... + l_{Dim-1} the reference simplex
+        // is N >= a_0 >= ... >= a_{Dim-1} >= 0, a union of the Kuhn simplices
+        // of the unit cells: corners c, c + e_p0, c + e_p0 + e_p1, ...
+        auto inside = [N]( std::array<int, Dim> const& a ) {
+            return a[0] <= N && a[Dim - 1] >= 0 && std::is_sorted( a.rbegin(), a.rend() );
+        };
+        std::array<int, Dim> perm;
+        for ( int c = 0; c < std::pow( N, Dim ); ++c )
+        {
+            std::array<int, Dim> base;
+            for ( int d = 0, r = c; d < Dim; ++d, r /= N )
+                base[d] = r % N;
+            std::iota( perm.begin(), perm.end(), 0 );
+            do
+            {
+                std::array<int, Dim + 1> sub;
+                auto a = base;
+                bool ok = true;
+                for ( int v = 0; v <= Dim && ok; ++v )
+                {
+                    if ( v > 0 )
+                        ++a[perm[v - 1]];
+                    if ( !( ok = inside( a ) ) )
+                        break;
+                    std::array<int, Dim> l;
+                    for ( int d = 0; d < Dim; ++d )
+                        l[d] = a[d] - ( d + 1 < Dim ? a[d + 1] : 0 );
+                    auto it = lattice.find( l );
+                    if ( it == lattice.end() )
+                        throw std::invalid_argument( "low order refined simplex: missing node on the lattice" );
+                    sub[v] = it->second;
+                }
+                if ( ok )
+                    low.addLinearSimplex( nodes, sub );
+            } while ( std::next_permutation( perm.begin(), perm.end() ) );
+        }
+        for ( int v = 0; v <= Dim; ++v )
+        {
+            low.faceMass_[v] = faceMass_[v].diagonal().asDiagonal();
+            low.faceMeasure_[v] = faceMeasure_[v];
+        }
+        return low;
+    }
+
+    int nLocalDofs() const { return n_; }
+    //! \f$\int \phi_j \phi_i\f$ on the reference simplex
+    Eigen::MatrixXd const& mass() const { return mass_; }
+    //! symmetric part of the stiffness for the p-th pair a <= b
+    Eigen::MatrixXd const& stiffness( int p ) const { return T_[p]; }
+    //! mass on the face opposite to the vertex @p v of the reference simplex
+    Eigen::MatrixXd const& faceMass( int v ) const { return faceMass_[v]; }
+    //! measure of the face opposite to the vertex @p v of the reference simplex
+    double faceMeasure( int v ) const { return faceMeasure_[v]; }
+
+    /**
+     * @brief geometric factors of an affine element
+     *
+     * @param P vertices of the element, one per column
+     * @param G factors of the stiffness pairs
+     * @return |det J|, the factor of the mass
+     */
+    static double geometry( Eigen::Matrix<double, Dim, Dim + 1> const& P, Eigen::Matrix<double, nPairs, 1>& G )
+    {
+        Eigen::Matrix<double, Dim, Dim> J = ( P.rightCols( Dim ).colwise() - P.col( 0 ) ) / 2;
+        double det = std::abs( J.determinant() );
+        Eigen::Matrix<double, Dim, Dim> Ji = J.inverse();
+        Eigen::Matrix<double, Dim, Dim> g = det * Ji * Ji.transpose();
+        for ( int a = 0, p = 0; a < Dim; ++a )
+            for ( int b = a; b < Dim; ++b, ++p )
+                G( p ) = g( a, b );
+        return det;
+    }
+
+    //! values of the basis at the reference point @p x
+    Eigen::VectorXd values( Eigen::Matrix<double, Dim, 1> const& x ) const { return C_.transpose() * monomials( x ); }
+
+    //! gradients of the basis at the reference point @p x, one row per basis function
+    Eigen::MatrixXd gradients( Eigen::Matrix<double, Dim, 1> const& x ) const
+    {
+        Eigen::MatrixXd dm( n_, Dim );
+        for ( int p = 0; p < n_; ++p )
+            for ( int d = 0; d < Dim; ++d )
+            {
+                auto a = exponents_[p];
+                if ( a( d ) == 0 )
+                {
+                    dm( p, d ) = 0;
+                    continue;
+                }
+                double c = a( d );
+                a( d ) -= 1;
+                dm( p, d ) = c * monomial( a, x );
+            }
+        return C_.transpose() * dm;
+    }
+
+private:
+    SimplexKernels() = default;
+
+    //! add the P1 matrices of the simplex with the nodes @p sub
+    void addLinearSimplex( Eigen::MatrixXd const& nodes, std::array<int, Dim + 1> const& sub )
+    {
+        Eigen::Matrix<double, Dim, Dim> J;
+        for ( int d = 0; d < Dim; ++d )
+            J.col( d ) = nodes.col( sub[d + 1] ) - nodes.col( sub[0] );
+        double vol = std::abs( J.determinant() );
+        for ( int d = 2; d <= Dim; ++d )
+            vol /= d;
+        // gradients of the barycentric coordinates, one row per vertex
+        Eigen::Matrix<double, Dim + 1, Dim> g;
+        g.bottomRows( Dim ) = J.inverse();
+        g.row( 0 ) = -g.bottomRows( Dim ).colwise().sum();
+        for ( int i = 0; i <= Dim; ++i )
+            for ( int j = 0; j <= Dim; ++j )
+            {
+                mass_( sub[i], sub[j] ) += vol * ( i == j ? 2. : 1. ) / ( ( Dim + 1 ) * ( Dim + 2 ) );
+                for ( int a = 0, p = 0; a < Dim; ++a )
+                    for ( int b = a; b < Dim; ++b, ++p )
+                        T_[p]( sub[i], sub[j] ) += vol * ( a == b ? g( i, a ) * g( j, a ) : g( i, b ) * g( j, a ) + g( i, a ) * g( j, b ) );
+            }
+    }
+
+    static double monomial( Eigen::Matrix<int, Dim, 1> const& a, Eigen::Matrix<double, Dim, 1> const& x )
+    {
+        double m = 1;
+        for ( int d = 0; d < Dim; ++d )
+            m *= std::pow( x( d ), a( d ) );
+        return m;
+    }
+    Eigen::VectorXd monomials( Eigen::Matrix<double, Dim, 1> const& x ) const
+    {
+        Eigen::VectorXd m( exponents_.size() );
+        for ( std::size_t p = 0; p < exponents_.size(); ++p )
+            m( p ) = monomial( exponents_[p], x );
+        return m;
+    }
+
+    int n_ = 0;
+    int order_ = 1;
+    std::vector<Eigen::Matrix<int, Dim, 1>> exponents_;
+    Eigen::MatrixXd C_, mass_;
+    std::array<Eigen::MatrixXd, nPairs> T_;
+    std::array<Eigen::MatrixXd, Dim + 1> faceMass_;
+    std::array<double, Dim + 1> faceMeasure_{};
+};
+
+} // namespace Feel
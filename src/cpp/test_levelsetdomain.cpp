@@ -0,0 +1,86 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief check of the narrow band update of LevelsetDomain against a full classification
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-29
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#include <feel/feelfilters/unithypercube.hpp>
+
+#include "levelsetdomain.hpp"
+
+namespace Feel
+{
+/**
+ * @brief number of elements whose status differs between @p a and @p b, on all the ranks
+ */
+template <typename MeshType>
+int mismatches( LevelsetDomain<MeshType> const& a, LevelsetDomain<MeshType> const& b )
+{
+    int n = 0;
+    for ( auto const& eltWrap : elements( a.mesh() ) )
+        n += a.status( unwrap_ref( eltWrap ) ) != b.status( unwrap_ref( eltWrap ) );
+    MPI_Allreduce( MPI_IN_PLACE, &n, 1, MPI_INT, MPI_SUM, a.mesh()->worldComm() );
+    return n;
+}
+} // namespace Feel
+
+int main( int argc, char** argv )
+{
+    using namespace Feel;
+    int status = 0;
+    try
+    {
+        Environment env( _argc = argc, _argv = argv,
+                         _about = about( _name = "test_levelsetdomain",
+                                         _author = "Feel++ Consortium",
+                                         _email = "feelpp@cemosis.fr" ) );
+        using mesh_t = Mesh<Simplex<2>>;
+        auto mesh = unitHypercube<2>();
+        int layers = 2;
+        LevelsetDomain<mesh_t> band( mesh, layers );
+        // a circle of radius 0.1, then moved by more than the band width in
+        // one update, then removed: the band must fall back on the full
+        // evaluation each time
+        for ( std::string phi : { "(x-0.25)^2+(y-0.25)^2-0.01:x:y",
+                                  "(x-0.3)^2+(y-0.25)^2-0.01:x:y",
+                                  "(x-0.75)^2+(y-0.75)^2-0.01:x:y",
+                                  "(x-0.5)^2+(y-0.5)^2-4:x:y",
+                                  "(x-0.5)^2+(y-0.5)^2+1:x:y" } )
+        {
+            band.update( phi );
+            LevelsetDomain<mesh_t> full( mesh, 0 );
+            full.update( phi );
+            int n = mismatches( band, full );
+            bool keys = band.activeKey() == full.activeKey();
+            if ( Environment::isMasterRank() )
+                std::cout << fmt::format( "{}: {} mismatches, {} full updates, same active key: {}", phi, n, band.fullUpdates(), keys ) << std::endl;
+            if ( n > 0 || !keys )
+                status = 1;
+        }
+    }
+    catch ( ... )
+    {
+        handleExceptions();
+        status = 1;
+    }
+    return status;
+}
@@ -0,0 +1,142 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief state shared by the instances running in several threads
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-22
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <mpi.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include <feel/feelcore/environment.hpp>
+#include <feel/feelvf/vf.hpp>
+#include <petscsys.h>
+
+namespace Feel
+{
+//! lock of the expression parser, which compiles the expressions in files named after them
+inline std::mutex& exprMutex()
+{
+    static std::mutex m;
+    return m;
+}
+
+//! @return expr( @p s ), parsed and compiled under exprMutex()
+inline auto parseExpr( std::string const& s )
+{
+    std::lock_guard<std::mutex> lock( exprMutex() );
+    return expr( s );
+}
+
+//! @return a number identifying an instance in the process, 0 for the first one
+inline int nextInstanceId()
+{
+    static std::atomic<int> n{ 0 };
+    return n++;
+}
+
+/**
+ * @brief MPI initialized with MPI_THREAD_MULTIPLE before the Feel++ environment
+ *
+ * the environment initializes MPI without thread support unless it is
+ * already initialized, e.g. by mpi4py in Python. An application creates it
+ * first in main() so that the exports and the solves may run in threads,
+ * MPI is then finalized after the environment.
+ */
+class MPIThreadMultiple
+{
+public:
+    MPIThreadMultiple( int& argc, char**& argv )
+    {
+        int initialized = 0;
+        MPI_Initialized( &initialized );
+        if ( initialized )
+            return;
+        int provided = MPI_THREAD_SINGLE;
+        MPI_Init_thread( &argc, &argv, MPI_THREAD_MULTIPLE, &provided );
+        owner_ = true;
+    }
+    MPIThreadMultiple( MPIThreadMultiple const& ) = delete;
+    MPIThreadMultiple& operator=( MPIThreadMultiple const& ) = delete;
+    ~MPIThreadMultiple()
+    {
+        int finalized = 0;
+        MPI_Finalized( &finalized );
+        if ( owner_ && !finalized )
+            MPI_Finalize();
+    }
+
+private:
+    bool owner_ = false;
+};
+
+/**
+ * @brief @return true if instances may solve at the same time in several threads
+ *
+ * PETSc must be built with thread safety, MPI must provide
+ * MPI_THREAD_MULTIPLE and the process must be alone: the collective
+ * communications of concurrent solves would not be matched in the same
+ * order by all the ranks.
+ */
+inline bool concurrentSolves()
+{
+#if defined( PETSC_HAVE_THREADSAFETY )
+    int provided = MPI_THREAD_SINGLE;
+    MPI_Query_thread( &provided );
+    return provided == MPI_THREAD_MULTIPLE && Environment::numberOfProcessors() == 1;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief lock held while an instance works in PETSc and MPI
+ *
+ * The instances of the threads run one at a time unless concurrentSolves(),
+ * the other threads, e.g. Python, keep running meanwhile. The lock is
+ * recursive so that a locked method may call another one.
+ */
+class SolveLock
+{
+public:
+    SolveLock()
+    {
+        static bool const concurrent = concurrentSolves();
+        if ( !concurrent )
+            lock_ = std::unique_lock<std::recursive_mutex>( mutex() );
+    }
+
+private:
+    static std::recursive_mutex& mutex()
+    {
+        static std::recursive_mutex m;
+        return m;
+    }
+
+    std::unique_lock<std::recursive_mutex> lock_;
+};
+
+} // namespace Feel
@@ -0,0 +1,243 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief scoped timers and counters aggregated over the MPI ranks
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-17
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <feel/feelcore/json.hpp>
+#include <fmt/core.h>
+
+namespace Feel
+{
+/**
+ * @brief gather a string of each rank
+ *
+ * @param root rank receiving the strings, -1 for all the ranks
+ * @return the strings of the ranks in rank order on the receiving ranks, empty otherwise
+ */
+inline std::vector<std::string> gatherStrings( MPI_Comm comm, std::string const& s, int root = -1 )
+{
+    int size, rank;
+    MPI_Comm_size( comm, &size );
+    MPI_Comm_rank( comm, &rank );
+    int n = static_cast<int>( s.size() );
+    std::vector<int> counts( size ), displs( size );
+    if ( root < 0 )
+        MPI_Allgather( &n, 1, MPI_INT, counts.data(), 1, MPI_INT, comm );
+    else
+        MPI_Gather( &n, 1, MPI_INT, counts.data(), 1, MPI_INT, root, comm );
+    for ( int r = 1; r < size; ++r )
+        displs[r] = displs[r - 1] + counts[r - 1];
+    std::string all( displs.back() + counts.back(), '\0' );
+    if ( root < 0 )
+        MPI_Allgatherv( s.data(), n, MPI_CHAR, all.data(), counts.data(), displs.data(), MPI_CHAR, comm );
+    else
+        MPI_Gatherv( s.data(), n, MPI_CHAR, all.data(), counts.data(), displs.data(), MPI_CHAR, root, comm );
+    std::vector<std::string> strings;
+    if ( root < 0 || rank == root )
+        for ( int r = 0; r < size; ++r )
+            strings.push_back( all.substr( displs[r], counts[r] ) );
+    return strings;
+}
+
+/**
+ * @brief timers and counters of the phases of a model
+ *
+ * A timer is an entry whose samples are durations in seconds, recorded by a
+ * Scope, a counter is an entry whose samples are values, e.g. iterations.
+ * Each entry keeps the number of samples, their sum, min and max on the
+ * rank. The timed scopes can also be recorded as events of a Chrome trace,
+ * which can be opened in chrome://tracing or https://ui.perfetto.dev, with
+ * one process per rank.
+ */
+class Timings
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct Entry
+    {
+        long count = 0;
+        double total = 0;
+        double min = std::numeric_limits<double>::infinity();
+        double max = -std::numeric_limits<double>::infinity();
+        bool timer = false;
+    };
+
+    //! records the time spent between its construction and its destruction
+    class Scope
+    {
+    public:
+        Scope( Timings& t, std::string name ) : t_( t ), name_( std::move( name ) ), start_( clock::now() ) {}
+        Scope( Scope const& ) = delete;
+        Scope& operator=( Scope const& ) = delete;
+        ~Scope() { t_.addTime( name_, start_, clock::now() ); }
+
+    private:
+        Timings& t_;
+        std::string name_;
+        clock::time_point start_;
+    };
+
+    Timings() : epoch_( clock::now() ) {}
+
+    //! @return a timer of the enclosing block
+    [[nodiscard]] Scope scope( std::string name ) { return Scope( *this, std::move( name ) ); }
+
+    //! add a sample @p value to the counter @p name
+    void add( std::string const& name, double value )
+    {
+        auto& e = entries_[name];
+        ++e.count;
+        e.total += value;
+        e.min = std::min( e.min, value );
+        e.max = std::max( e.max, value );
+    }
+
+    void addTime( std::string const& name, clock::time_point start, clock::time_point end )
+    {
+        add( name, std::chrono::duration<double>( end - start ).count() );
+        entries_[name].timer = true;
+        if ( trace_ )
+            events_.push_back( { name,
+                                 std::chrono::duration<double, std::micro>( start - epoch_ ).count(),
+                                 std::chrono::duration<double, std::micro>( end - start ).count() } );
+    }
+
+    //! record the scopes as trace events, see writeTrace()
+    void setTrace( bool t ) { trace_ = t; }
+    bool trace() const { return trace_; }
+
+    void clear()
+    {
+        entries_.clear();
+        events_.clear();
+    }
+
+    std::map<std::string, Entry> const& entries() const { return entries_; }
+
+    //! entries of the rank
+    nl::json localJson() const
+    {
+        nl::json j = nl::json::object();
+        for ( auto const& [name, e] : entries_ )
+            j[name] = { { "count", e.count }, { "total", e.total }, { "min", e.min }, { "max", e.max }, { "timer", e.timer } };
+        return j;
+    }
+
+    /**
+     * @brief entries aggregated over the ranks of @p comm, collective
+     *
+     * for each entry: the number of ranks and of samples, the min, max and
+     * mean over the ranks of the total of the rank, the imbalance max/mean
+     * and the min and max of the samples
+     */
+    nl::json toJson( MPI_Comm comm ) const
+    {
+        std::map<std::string, std::vector<nl::json>> all;
+        for ( auto const& s : gatherStrings( comm, localJson().dump() ) )
+            for ( auto const& [name, e] : nl::json::parse( s ).items() )
+                all[name].push_back( e );
+        nl::json j = nl::json::object();
+        for ( auto const& [name, es] : all )
+        {
+            long count = 0;
+            double tmin = std::numeric_limits<double>::infinity(), tmax = 0, tsum = 0;
+            double smin = std::numeric_limits<double>::infinity(), smax = -std::numeric_limits<double>::infinity();
+            for ( auto const& e : es )
+            {
+                double t = e["total"];
+                count += e["count"].get<long>();
+                tmin = std::min( tmin, t );
+                tmax = std::max( tmax, t );
+                tsum += t;
+                smin = std::min( smin, e["min"].get<double>() );
+                smax = std::max( smax, e["max"].get<double>() );
+            }
+            double mean = tsum / es.size();
+            j[name] = { { "ranks", es.size() },
+                        { "count", count },
+                        { "min", tmin },
+                        { "max", tmax },
+                        { "mean", mean },
+                        { "imbalance", mean > 0 ? tmax / mean : 1. },
+                        { "sample_min", smin },
+                        { "sample_max", smax },
+                        { "unit", es.front().value( "timer", false ) ? "s" : "" } };
+        }
+        return j;
+    }
+
+    /**
+     * @brief write the recorded scopes of the ranks of @p comm as a Chrome trace, collective
+     *
+     * the rank 0 writes @p filename, one process per rank
+     */
+    void writeTrace( std::string const& filename, MPI_Comm comm ) const
+    {
+        int rank;
+        MPI_Comm_rank( comm, &rank );
+        nl::json events = nl::json::array();
+        for ( auto const& e : events_ )
+            events.push_back( { { "name", e.name }, { "ph", "X" }, { "ts", e.start }, { "dur", e.duration }, { "pid", rank }, { "tid", 0 } } );
+        auto all = gatherStrings( comm, events.dump(), 0 );
+        if ( rank != 0 )
+            return;
+        nl::json trace = { { "traceEvents", nl::json::array() }, { "displayTimeUnit", "ms" } };
+        for ( std::size_t r = 0; r < all.size(); ++r )
+        {
+            trace["traceEvents"].push_back( { { "name", "process_name" }, { "ph", "M" }, { "pid", r }, { "args", { { "name", fmt::format( "rank {}", r ) } } } } );
+            for ( auto& e : nl::json::parse( all[r] ) )
+                trace["traceEvents"].push_back( std::move( e ) );
+        }
+        std::ofstream out( filename );
+        if ( !out )
+            throw std::runtime_error( fmt::format( "Unable to open file: {}", filename ) );
+        out << trace.dump();
+    }
+
+private:
+    struct Event
+    {
+        std::string name;
+        double start, duration;
+    };
+
+    clock::time_point epoch_;
+    bool trace_ = false;
+    std::map<std::string, Entry> entries_;
+    std::vector<Event> events_;
+};
+
+} // namespace Feel
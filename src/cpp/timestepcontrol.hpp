@@ -0,0 +1,96 @@
+//! -*- mode: c++; coding: utf-8; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4; show-trailing-whitespace: t  -*- vim:fenc=utf-8:ft=cpp:et:sw=4:ts=4:sts=4
+//!
+//! This file is part of the Feel++ library
+//!
+//! This library is free software; you can redistribute it and/or
+//! modify it under the terms of the GNU Lesser General Public
+//! License as published by the Free Software Foundation; either
+//! version 2.1 of the License, or (at your option) any later version.
+//!
+//! This library is distributed in the hope that it will be useful,
+//! but WITHOUT ANY WARRANTY; without even the implied warranty of
+//! MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//! Lesser General Public License for more details.
+//!
+//! You should have received a copy of the GNU Lesser General Public
+//! License along with this library; if not, write to the Free Software
+//! Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//!
+//! @file
+//! @brief controller of the time step of the adaptive time loop
+//! @author Christophe Prud'homme <christophe.prudhomme@cemosis.fr>
+//! @date 2024-11-15
+//! @copyright 2024 Feel++ Consortium
+//! @copyright 2024 Université de Strasbourg
+//!
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include <feel/feelcore/json.hpp>
+
+namespace Feel
+{
+/**
+ * @brief time step controller driven by an estimate of the local error
+ *
+ * read from /TimeStepping/<model>/adaptive, enabled as soon as the object is
+ * present unless "enabled" is false:
+ * - "tol": tolerance on the relative local error (1e-3)
+ * - "dt_min", "dt_max": bounds of the time step (step/100 and 100*step)
+ * - "safety": safety factor of the step proposal (0.9)
+ * - "grow", "shrink": bounds of the ratio between two steps (2 and 0.25)
+ * - "hold": the step is kept unless it can grow by at least this ratio (1.5),
+ *   which avoids setting up the preconditioner again for small changes
+ * - "steady_tol": stop when the relative change of the solution over a step
+ *   is below this tolerance, 0 (default) disables the test
+ *
+ * the error of the implicit Euler scheme is O(dt^2), the proposal is
+ * dt * safety * sqrt(tol/err)
+ */
+struct TimeStepController
+{
+    bool enabled = false;
+    double dtMin = 0, dtMax = 0;
+    double tol = 1e-3;
+    double safety = 0.9;
+    double grow = 2, shrink = 0.25, hold = 1.5;
+    double steadyTol = 0;
+
+    TimeStepController() = default;
+    /**
+     * @param j adaptive spec
+     * @param dt initial time step
+     */
+    TimeStepController( nl::json const& j, double dt )
+    {
+        dtMin = dt / 100;
+        dtMax = dt * 100;
+        if ( !j.is_object() )
+            return;
+        enabled = j.value( "enabled", true );
+        dtMin = j.value( "dt_min", dt / 100 );
+        dtMax = j.value( "dt_max", dt * 100 );
+        tol = j.value( "tol", 1e-3 );
+        safety = j.value( "safety", 0.9 );
+        grow = std::max( 1., j.value( "grow", 2. ) );
+        shrink = std::clamp( j.value( "shrink", 0.25 ), 1e-3, 1. );
+        hold = std::max( 1., j.value( "hold", 1.5 ) );
+        steadyTol = j.value( "steady_tol", 0. );
+    }
+
+    //! @return true if a step of size @p dt with estimated error @p err is accepted
+    bool accept( double dt, double err ) const { return err <= tol || dt <= dtMin * ( 1 + 1e-12 ); }
+
+    //! @return the next time step after a step of size @p dt with estimated error @p err
+    double next( double dt, double err ) const
+    {
+        double f = err > 0 ? safety * std::sqrt( tol / err ) : grow;
+        if ( f >= 1 && f < hold )
+            return dt;
+        return std::clamp( dt * std::clamp( f, shrink, grow ), dtMin, dtMax );
+    }
+};
+
+} // namespace Feel
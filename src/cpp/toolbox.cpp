@@ -1,6 +1,8 @@
 #include <feel/feelcore/environment.hpp>
 #include <feel/feelmodels/electric/electric.hpp>
 
+#include "cachedsourceterm.hpp"
+
 int main(int argc, char** argv)
 {
     using namespace Feel;
@@ -23,25 +25,18 @@ int main(int argc, char** argv)
     electric->init();
     electric->printAndSaveInfo();
 
+    // the source term is parsed once and, unless it depends on t, assembled once
+    using space_t = typename std::decay_t<decltype( electric->spaceElectricPotential() )>::element_type;
+    CachedSourceTerm<space_t> source( electric->spaceElectricPotential(), soption( "myexpr" ) );
+
     // create a lambda function
-    auto lambda = [&electric](FeelModels::ModelAlgebraic::DataUpdateLinear & data) {
+    auto lambda = [&electric, &source](FeelModels::ModelAlgebraic::DataUpdateLinear & data) {
                       // build each time, not just for the constant part
                       bool buildCstPart = data.buildCstPart();
                       if( buildCstPart )
                           return;
-                      // retrieve matrix and vector already assemble
-                      sparse_matrix_ptrtype& A = data.matrix();
-                      vector_ptrtype& F = data.rhs();
-                      // retrieve space and create a test function
-                      auto Xh = electric->spaceElectricPotential();
-                      auto v = Xh->element();
-
-                      // create a linear form from the vector on the function space
-                      auto f = form1( _test=Xh, _vector=F);
-                      // get an expression from the options (or from another equation)
-                      auto e = expr(soption("myexpr"));
-                      // add the term to the linear form
-                      f += integrate( _range=elements(support(Xh)), _expr=inner(e, id(v)) );
+                      // add the term to the vector already assembled
+                      source.addTo( data.rhs(), electric->time() );
                   };
     // add the lambda function to the algebraic factory
     electric->algebraicFactory()->addFunctionLinearAssembly(lambda);
@@ -1,13 +1,64 @@
 import feelpp.core as fppc
 from ._laplacian import *
+import asyncio
 import json
+import os
+from concurrent.futures import ThreadPoolExecutor
 
 _laps = {
     'laplacian(2,1)': Laplacian2DP1,
     'laplacian(2,2)': Laplacian2DP2,
+    'laplacian(2,3)': Laplacian2DP3,
+    'laplacian(3,1)': Laplacian3DP1,
+    'laplacian(3,2)': Laplacian3DP2,
 }
 
 
+_executor = None
+
+
+def defaultExecutor():
+    """return the executor of run_async
+
+    It has one worker unless concurrentSolves() is true: the solves take turns
+    anyway and all the ranks then run the instances in the order of submission.
+    """
+    global _executor
+    if _executor is None:
+        workers = os.cpu_count() if concurrentSolves() else 1
+        _executor = ThreadPoolExecutor(max_workers=workers, thread_name_prefix='laplacian')
+    return _executor
+
+
+def _run_async(self, executor=None):
+    """run the instance in a worker thread
+
+    The GIL is released while the instance works, the calling thread keeps
+    running Python code, e.g. the postprocessing of the previous sample.
+    The instances must be submitted in the same order on all the ranks.
+
+    Args:
+        executor: concurrent.futures executor, defaults to defaultExecutor()
+
+    Returns:
+        asyncio.Future if called from a running event loop, otherwise
+        concurrent.futures.Future, its result is the instance
+    """
+    def work():
+        self.run()
+        return self
+    future = (executor or defaultExecutor()).submit(work)
+    try:
+        asyncio.get_running_loop()
+    except RuntimeError:
+        return future
+    return asyncio.wrap_future(future)
+
+
+for _lap in _laps.values():
+    _lap.run_async = _run_async
+
+
 def get(dim=2, order=1, worldComm=None):
     """create a Laplacian operator
 
@@ -19,9 +70,63 @@ def get(dim=2, order=1, worldComm=None):
         raise RuntimeError('Laplacian'+key+' is not available')
     return _laps[key]()
 
+def reducedBasis(lap):
+    """create the reduced basis of the steady problem of an initialized Laplacian
+
+    Args:
+        lap: Laplacian instance, e.g. from get(), after initialize() or run()
+
+    Returns:
+        ReducedBasis instance, parametrized by the conductivities and h
+    """
+    return globals()[type(lap).__name__.replace('Laplacian', 'ReducedBasis')](lap)
+
+def meshAdaptation(lap):
+    """create the adaptive mesh refinement loop of a Laplacian
+
+    Args:
+        lap: Laplacian instance, its specs hold /Adaptivity/laplacian
+
+    Returns:
+        MeshAdaptation instance, run() replaces lap.run()
+    """
+    return globals()[type(lap).__name__.replace('Laplacian', 'MeshAdaptation')](lap)
+
 def loadSpecs(jsonfile):
     # Reading the JSON file
     with open(jsonfile, 'r') as file:
         data = json.load(file)
     return data
 
+
+def loadMeasures(filename):
+    """load the measures written by a Laplacian instance
+
+    Args:
+        filename (str): csv, json or binary (FPMEAS1) measures file
+
+    Returns:
+        dict: one array per measure
+    """
+    import numpy as np
+    if filename.endswith('.csv'):
+        data = np.genfromtxt(filename, delimiter=',', names=True)
+        return {name: data[name] for name in data.dtype.names}
+    if filename.endswith('.json'):
+        return loadSpecs(filename)
+    with open(filename, 'rb') as file:
+        if file.read(8) != b'FPMEAS1\n':
+            raise RuntimeError(f'{filename} is not a measures file')
+        ncols = int(np.frombuffer(file.read(8), dtype=np.int64)[0])
+        names = []
+        for _ in range(ncols):
+            name = b''
+            while (c := file.read(1)) != b'\0':
+                name += c
+            names.append(name.decode())
+        columns = {name: [] for name in names}
+        while header := file.read(8):
+            nrows = int(np.frombuffer(header, dtype=np.int64)[0])
+            for name in names:
+                columns[name].append(np.frombuffer(file.read(8 * nrows), dtype=np.float64))
+    return {name: np.concatenate(chunks) for name, chunks in columns.items()}
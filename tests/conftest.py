@@ -0,0 +1,25 @@
+from __future__ import annotations
+
+from pathlib import Path
+
+import pytest
+
+fppc = pytest.importorskip("feelpp.core")
+
+FIN = Path(__file__).resolve().parents[1] / "src" / "cases" / "laplacian" / "fin"
+
+
+@pytest.fixture(scope="session")
+def env():
+    """Feel++ environment of the test session, configured for the fin case"""
+    e = fppc.Environment(["fin"], config=fppc.localRepository("."))
+    fppc.Environment.setConfigFile(str(FIN / "fin1" / "fin2d.cfg"))
+    return e
+
+
+@pytest.fixture
+def fin2d(env):
+    """specs of the 2D thermal fin"""
+    from feelpp.project import laplacian
+
+    return laplacian.loadSpecs(str(FIN / "fin2d.json"))
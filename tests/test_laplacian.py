@@ -0,0 +1,110 @@
+from __future__ import annotations
+
+import copy
+
+import numpy as np
+import pytest
+
+
+def test_u_array_survives_run(fin2d):
+    from feelpp.project import laplacian
+
+    lap = laplacian.get(dim=2, order=1)
+    lap.setSpecs(fin2d)
+    lap.initialize()
+    view = lap.uArray()
+    lap.run()
+    # run() initializes the model again on the same space: the view taken
+    # before still points to the storage of u
+    assert np.shares_memory(view, lap.uArray())
+    assert np.array_equal(view, lap.uArray())
+    assert np.isclose(view.max(), lap.measures()["max"][-1])
+
+
+def test_solve_batch_rejects_time_dependent_operator(fin2d):
+    from feelpp.project import laplacian
+
+    lap = laplacian.get(dim=2, order=1)
+    lap.setSpecs(fin2d)
+    with pytest.raises(ValueError, match="depends on time"):
+        lap.solveBatch([{"Materials": {"Fin_1": {"k": "1+t:t"}}}])
+
+
+def test_solve_batch_starts_from_initial_conditions(fin2d):
+    from feelpp.project import laplacian
+
+    # a batch ignores the restart: a missing checkpoint does not throw
+    specs = copy.deepcopy(fin2d)
+    specs["TimeStepping"]["laplacian"]["restart"] = "no-such-checkpoints"
+    lap = laplacian.get(dim=2, order=1)
+    lap.setSpecs(specs)
+    lap.solveBatch([{}, {"BoundaryConditions": {"laplacian": {"flux": {"Gamma_root": {"expr": "2"}}}}}])
+    batch = lap.measures()["max"]
+
+    lap.setSpecs(fin2d)
+    lap.run()
+    assert np.isclose(batch[0], lap.measures()["max"][-1], rtol=1e-6)
+
+
+def test_timings_require_a_space(env):
+    from feelpp.project import laplacian
+
+    # a default instance has no space yet: nothing to aggregate the timings on
+    lap = laplacian.get(dim=2, order=1)
+    with pytest.raises(RuntimeError, match="no space"):
+        lap.timings()
+    with pytest.raises(RuntimeError, match="no space"):
+        lap.writeTrace("trace.json")
+
+
+def test_greedy_stops_when_the_snapshots_are_in_the_basis(fin2d):
+    from feelpp.project import laplacian
+
+    lap = laplacian.get(dim=2, order=1)
+    lap.setSpecs(fin2d)
+    lap.initialize()
+    rb = laplacian.reducedBasis(lap)
+    # a degenerate box: every training parameter is the reference one, its
+    # snapshot is already in the basis and the greedy must not loop on it
+    mu = np.ones(rb.nParameters())
+    errors = rb.offline(mu, mu, nmax=5, tol=-1, ntrain=3)
+    assert rb.size() == 1
+    assert len(errors) == 1
+
+
+def test_assemble_into_matches_the_forms(fin2d):
+    from feelpp.project import laplacian
+
+    lap = laplacian.get(dim=2, order=1)
+    lap.setSpecs(fin2d)
+    lap.initialize()
+    materials = fin2d["Models"]["laplacian"]["Materials"]
+    coeffs = np.array([[2.0, 0.0], [0.0, 3.0]])
+
+    def distance(A, B):
+        D = A.mat().copy()
+        D.axpy(-1.0, B.mat())
+        return D.norm() / max(B.mat().norm(), 1e-300)
+
+    # the matrix is reused: a second assembly without add zeroes it first
+    M = lap.newMatrix()
+    lap.assembleMassInto(M, materials[:1])
+    lap.assembleGradGradInto(M, materials, coeffs)
+    assert distance(M, lap.assembleGradGrad(materials, coeffs).matrixPtr()) < 1e-12
+    lap.assembleMassInto(M, materials, 2.0)
+    assert distance(M, lap.assembleMass(materials, 2.0).matrixPtr()) < 1e-12
+    # with add the terms accumulate
+    lap.assembleGradGradInto(M, materials, coeffs, add=True)
+    S = lap.assembleGradGrad(materials, coeffs).matrixPtr().mat().copy()
+    S.axpy(1.0, lap.assembleMass(materials, 2.0).matrixPtr().mat())
+    D = M.mat().copy()
+    D.axpy(-1.0, S)
+    assert D.norm() <= 1e-12 * S.norm()
+
+    F = lap.newVector()
+    lap.assembleFluxInto(F, ["Gamma_root"], 3.0)
+    G = lap.assembleFlux(["Gamma_root"], 3.0).vectorPtr().vec()
+    D = F.vec().copy()
+    D.axpy(-1.0, G)
+    assert D.norm() <= 1e-12 * G.norm()
+    assert G.norm() > 0